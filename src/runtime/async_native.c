@@ -4,6 +4,7 @@
 #include <time.h>
 #include <sys/select.h>
 #include <stdint.h>
+#include <stdlib.h>
 
 // sf_time_now() -> double (seconds since monotonic epoch)
 double sf_time_now(void) {
@@ -93,38 +94,223 @@ int64_t __sched_get_task_result(void) { return __task_result; }
 void __sched_reset_yield(void) { __yield_reason = 0; __yield_arg = 0; }
 
 // --- Per-task result storage ---
-// Fixed-size table of (handle, result) pairs.
-// The scheduler calls store_result when a task finishes.
-// task.await() / task.getResult() calls get_stored_result.
-#define MAX_TASK_RESULTS 256
-static struct { int64_t handle; int64_t value; } __task_results[MAX_TASK_RESULTS];
-static int __task_result_count = 0;
+// One control block per finished (or awaited) task, found from the coroutine
+// handle through an open-addressing table: linear probing, backward-shift
+// deletion, key 0 = empty (a frame address is never 0). The same shape as the
+// scheduler's IntTable.
+//
+// Reading a result never releases it: task.await() and task.getResult() can
+// be called any number of times, from any number of tasks, and each gets the
+// value. A block lives until the collector finds that nothing can read it
+// again. Task handles are not GC objects, so gc.ll reports every untagged,
+// pointer-shaped value it reaches while marking (__sched_gc_note); a finished
+// task whose handle was not among them, and that no await is in progress on
+// (__sched_result_pin), has its block released (__sched_gc_sweep_results). A
+// block always survives the first collection after the task finishes, which
+// covers a handle still on its way from Task.spawn into a variable or a list.
+// A fire-and-forget Task.spawn therefore costs a block for at most two
+// collections. A read before the task has finished returns 0.
+//
+// The collector also treats the value of every finished task's block as a
+// root (__sched_gc_mark_results), so a heap result lives exactly as long as
+// its block. Releasing a block also destroys the task's frame, which sends it
+// back to the frame pool: the handle that was the only way to reach it is
+// gone. Spawned frames have no other point of release, because the scheduler
+// cannot know when user code is done with a Task.
 
-void __sched_store_result(int64_t handle, int64_t value) {
-    if (__task_result_count < MAX_TASK_RESULTS) {
-        __task_results[__task_result_count].handle = handle;
-        __task_results[__task_result_count].value = value;
-        __task_result_count++;
+typedef struct {
+    int64_t handle;
+    int64_t value;
+    int64_t pins;                  // awaits in progress
+    int64_t done;
+    int64_t seen;                  // reached by the current mark phase
+} task_result;
+
+static task_result *__results = NULL;   // control blocks, by slot
+static int64_t __results_cap = 0;
+static int64_t __results_free = -1;     // free list, threaded through .value
+static int64_t __results_used = 0;      // slots ever handed out
+
+static int64_t *__rt_keys = NULL;       // handle -> slot + 1 (0 = empty key)
+static int64_t *__rt_slots = NULL;
+static int64_t __rt_cap = 0, __rt_count = 0;
+
+static int64_t __rt_home(int64_t key) {
+    return ((key >> 4) ^ (key >> 12) ^ (key >> 24)) & (__rt_cap - 1);
+}
+
+static int64_t __rt_find(int64_t handle) {
+    if (__rt_cap == 0 || handle == 0) return -1;
+    int64_t i = __rt_home(handle);
+    while (__rt_keys[i] != 0) {
+        if (__rt_keys[i] == handle) return __rt_slots[i];
+        i = (i + 1) & (__rt_cap - 1);
     }
+    return -1;
 }
 
-int64_t __sched_get_stored_result(int64_t handle) {
-    for (int i = __task_result_count - 1; i >= 0; i--) {
-        if (__task_results[i].handle == handle) {
-            return __task_results[i].value;
+static void __rt_put(int64_t handle, int64_t slot) {
+    int64_t i = __rt_home(handle);
+    while (__rt_keys[i] != 0) i = (i + 1) & (__rt_cap - 1);
+    __rt_keys[i] = handle;
+    __rt_slots[i] = slot;
+    __rt_count++;
+}
+
+static int __rt_grow(void) {
+    int64_t old_cap = __rt_cap;
+    int64_t *old_keys = __rt_keys, *old_slots = __rt_slots;
+    int64_t cap = old_cap ? old_cap * 2 : 64;
+    int64_t *keys = calloc((size_t)cap, sizeof(int64_t));
+    int64_t *slots = malloc((size_t)cap * sizeof(int64_t));
+    if (!keys || !slots) { free(keys); free(slots); return 0; }
+    __rt_keys = keys;
+    __rt_slots = slots;
+    __rt_cap = cap;
+    __rt_count = 0;
+    for (int64_t i = 0; i < old_cap; i++) {
+        if (old_keys[i] != 0) __rt_put(old_keys[i], old_slots[i]);
+    }
+    free(old_keys);
+    free(old_slots);
+    return 1;
+}
+
+// Backward-shift deletion: pull later entries of the same probe run back into
+// the hole so lookups never need tombstones.
+static void __rt_remove(int64_t handle) {
+    int64_t mask = __rt_cap - 1;
+    int64_t i = __rt_home(handle);
+    while (__rt_keys[i] != handle) {
+        if (__rt_keys[i] == 0) return;
+        i = (i + 1) & mask;
+    }
+    int64_t hole = i;
+    int64_t j = (i + 1) & mask;
+    while (__rt_keys[j] != 0) {
+        int64_t home = __rt_home(__rt_keys[j]);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            __rt_keys[hole] = __rt_keys[j];
+            __rt_slots[hole] = __rt_slots[j];
+            hole = j;
         }
+        j = (j + 1) & mask;
     }
-    return 0;
+    __rt_keys[hole] = 0;
+    __rt_count--;
+}
+
+// The block for `handle`, created (not done, not pinned) if it has none.
+static int64_t __rt_block(int64_t handle) {
+    int64_t slot = __rt_find(handle);
+    if (slot >= 0 || handle == 0) return slot;
+    if ((__rt_count + 1) * 2 > __rt_cap && !__rt_grow()) return -1;
+    if (__results_free >= 0) {
+        slot = __results_free;
+        __results_free = __results[slot].value;
+    } else {
+        if (__results_used == __results_cap) {
+            int64_t cap = __results_cap ? __results_cap * 2 : 64;
+            task_result *grown = realloc(__results, (size_t)cap * sizeof(task_result));
+            if (!grown) return -1;
+            __results = grown;
+            __results_cap = cap;
+        }
+        slot = __results_used++;
+    }
+    __results[slot].handle = handle;
+    __results[slot].value = 0;
+    __results[slot].pins = 0;
+    __results[slot].done = 0;
+    __results[slot].seen = 0;
+    __rt_put(handle, slot);
+    return slot;
+}
+
+static void __rt_release(int64_t slot) {
+    __rt_remove(__results[slot].handle);
+    __results[slot].handle = 0;
+    __results[slot].value = __results_free;
+    __results_free = slot;
+}
+
+void __sched_store_result(int64_t handle, int64_t value) {
+    int64_t slot = __rt_block(handle);
+    if (slot < 0) return;
+    __results[slot].value = value;
+    __results[slot].done = 1;
+    // Spared by the next collection: the handle may not have reached a root
+    // yet (Task.spawn has only just returned it).
+    __results[slot].seen = 1;
+}
+
+// An await on `handle` has begun. Its handle may live only in a register or a
+// suspended frame until it reads the result, where the collector cannot see
+// it, so the block is kept until the matching unpin.
+void __sched_result_pin(int64_t handle) {
+    int64_t slot = __rt_block(handle);
+    if (slot >= 0) __results[slot].pins++;
+}
+
+void __sched_result_unpin(int64_t handle) {
+    int64_t slot = __rt_find(handle);
+    if (slot >= 0 && __results[slot].pins > 0) __results[slot].pins--;
+}
+
+// task.await(), task.getResult() and Scheduler.get_result: the result of
+// finished task `handle`, or 0.
+int64_t __sched_get_stored_result(int64_t handle) {
+    int64_t slot = __rt_find(handle);
+    if (slot < 0 || !__results[slot].done) return 0;
+    return __results[slot].value;
 }
 
 // Check if a task has a stored result (i.e., has completed)
 int64_t __sched_has_stored_result(int64_t handle) {
-    for (int i = __task_result_count - 1; i >= 0; i--) {
-        if (__task_results[i].handle == handle) {
-            return 1;
+    int64_t slot = __rt_find(handle);
+    return slot >= 0 && __results[slot].done ? 1 : 0;
+}
+
+// Live result blocks (for tests and Scheduler.result_blocks).
+int64_t __sched_result_blocks(void) {
+    return __rt_count;
+}
+
+// --- Collector hooks (gc.ll, __gc_mark and __gc_collect) ---
+extern void __gc_mark_object(int64_t val);
+void __sched_coro_destroy(int64_t hdl_i64);
+
+void __sched_gc_mark_results(void) {
+    for (int64_t i = 0; i < __results_used; i++) {
+        if (__results[i].handle != 0 && __results[i].done) __gc_mark_object(__results[i].value);
+    }
+}
+
+// `val` was reached while marking and is not a GC object.
+void __sched_gc_note(int64_t val) {
+    if (__rt_count == 0) return;
+    int64_t slot = __rt_find(val);
+    if (slot >= 0) __results[slot].seen = 1;
+}
+
+// After marking: release every finished, unpinned block whose handle the
+// program no longer holds, with its frame, and clear the seen flags for the
+// next collection. A value reached only through a block released here is
+// freed by the next collection rather than this one. The destroy only runs
+// the frame's cleanup, which hands it to __sf_coro_free; nothing there
+// allocates.
+void __sched_gc_sweep_results(void) {
+    for (int64_t i = 0; i < __results_used; i++) {
+        task_result *r = &__results[i];
+        if (r->handle == 0) continue;
+        if (r->done && !r->seen && r->pins == 0) {
+            int64_t frame = r->handle;
+            __rt_release(i);
+            __sched_coro_destroy(frame);
+        } else {
+            r->seen = 0;
         }
     }
-    return 0;
 }
 
 // Coroutine frame layout after LLVM CoroSplit:
@@ -153,12 +339,102 @@ __attribute__((noinline)) int64_t __sched_coro_done(int64_t hdl_i64) {
     return (resume_fn == (coro_fn_t)0) ? 1 : 0;
 }
 
+// --- Actor busy word ---
+// The first word of an actor object is its busy flag (the hidden
+// `__actor_busy` field). Compiled actor dispatch reads and writes it inline;
+// the scheduler takes it through these while it delivers an actor's mailbox.
+int64_t __sched_actor_busy(int64_t actor) {
+    if (!actor) return 0;
+    return *(int64_t *)actor;
+}
+
+void __sched_actor_set_busy(int64_t actor, int64_t busy) {
+    if (!actor) return;
+    *(int64_t *)actor = busy;
+}
+
+// An io_uring op the task was parked on is released with it.
+extern void sf_uring_forget(int64_t token);
+
 void __sched_coro_destroy(int64_t hdl_i64) {
     void *hdl = (void *)hdl_i64;
     if (!hdl) return;
+    sf_uring_forget(hdl_i64);
     coro_fn_t *fn_ptrs = (coro_fn_t *)hdl;
     coro_fn_t destroy_fn = fn_ptrs[1];
     if (!destroy_fn) return;
     destroy_fn(hdl);
 }
 
+
+// --- Coroutine frame pool ---
+// Every coroutine frame comes from __sf_coro_alloc and goes back through
+// __sf_coro_free (the frame's destroy path, after llvm.coro.free). Frames come
+// in a handful of sizes, so freed frames are kept on one free list per 64-byte
+// size class and handed straight back out; only frames over 4 KB go to
+// __sf_malloc and __sf_free each time.
+//
+// A 16-byte header in front of the frame records its class and links the free
+// list. Pooled memory is never returned to malloc. That keeps it mapped for the
+// one reader that may still look at a dead frame: a coroutine that finished
+// while other frames' roots sat above its own leaves its shadow-stack entries
+// behind (see the __coro_final epilogue in output_body.sf), and the collector
+// reads through them. A freed frame also reads as finished (resume = NULL) and
+// has nothing to destroy (destroy = NULL) until it is handed out again.
+//
+// No lock: frames are only created and destroyed by managed code, which runs
+// on one thread at a time (the GRL, thread_native.c).
+#define CORO_CLASS_SHIFT 6
+#define CORO_CLASSES 64
+
+typedef struct coro_header {
+    int64_t cls;                   // size class, or 0 for an unpooled frame
+    struct coro_header *next;      // free-list link while pooled
+} coro_header;
+
+extern void *__sf_malloc(int64_t size);
+extern void __sf_free(void *p);
+
+static coro_header *__coro_pool[CORO_CLASSES + 1];
+static int64_t __coro_fresh = 0;   // pooled frames carved from __sf_malloc
+
+void *__sf_coro_alloc(int64_t size) {
+    if (size <= 0) return NULL;    // heap elision: llvm.coro.alloc said no
+    int64_t cls = (size + (1 << CORO_CLASS_SHIFT) - 1) >> CORO_CLASS_SHIFT;
+    coro_header *h;
+    if (cls > CORO_CLASSES) {
+        h = __sf_malloc((int64_t)sizeof(coro_header) + size);
+        if (!h) return NULL;
+        h->cls = 0;
+        return h + 1;
+    }
+    h = __coro_pool[cls];
+    if (h) {
+        __coro_pool[cls] = h->next;
+    } else {
+        h = __sf_malloc((int64_t)sizeof(coro_header) + (cls << CORO_CLASS_SHIFT));
+        if (!h) return NULL;
+        h->cls = cls;
+        __coro_fresh++;
+    }
+    return h + 1;
+}
+
+// How many pooled frames have ever been allocated, as opposed to reused.
+int64_t __sf_coro_frames(void) {
+    return __coro_fresh;
+}
+
+void __sf_coro_free(void *frame) {
+    if (!frame) return;
+    coro_header *h = (coro_header *)frame - 1;
+    if (h->cls == 0) {
+        __sf_free(h);
+        return;
+    }
+    coro_fn_t *fn_ptrs = (coro_fn_t *)frame;
+    fn_ptrs[0] = (coro_fn_t)0;
+    fn_ptrs[1] = (coro_fn_t)0;
+    h->next = __coro_pool[h->cls];
+    __coro_pool[h->cls] = h;
+}
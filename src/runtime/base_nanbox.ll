@@ -27,6 +27,8 @@ declare void @__sched_reset_yield()
 declare void @__sched_store_result(i64, i64)
 declare i64 @__sched_get_stored_result(i64)
 declare i64 @__sched_has_stored_result(i64)
+declare void @__sched_result_pin(i64)
+declare void @__sched_result_unpin(i64)
 
 ; --- Typed IO dispatch (compile-time polymorphism) ---
 ; All values are i64. The codegen picks the right variant at compile time.
@@ -1016,6 +1018,21 @@ entry:
   ret i64 0
 }
 
+define weak void @__mem_set_soft_limit(i64 %bytes) {
+entry:
+  ret void
+}
+
+define weak i64 @__mem_get_soft_limit() {
+entry:
+  ret i64 0
+}
+
+define weak i64 @__mem_pressure_collections() {
+entry:
+  ret i64 0
+}
+
 ; __gc_alloc: allocate size bytes, return user pointer.
 ; Weak fallback just calls malloc (no header, no tracking).
 define weak i64 @__gc_alloc(i64 %size, i64 %type_tag) {
@@ -1131,6 +1148,111 @@ entry:
   ret i64 0
 }
 
+; Heap profiler hooks called from gc.ll's allocator and sweep. The real ones
+; are in heapprof_native.c; the compiler links gc.ll without the natives, and
+; there the sample countdown is never armed, so these are never reached.
+define weak void @__heapprof_sample(i64 %user_ptr, i64 %size) {
+entry:
+  ret void
+}
+
+define weak void @__heapprof_free(i64 %user_ptr, i64 %size) {
+entry:
+  ret void
+}
+
+; GC telemetry sink called by gc.ll after every collection; the real one is
+; in gctrace_native.c, which the compiler's own link does not include.
+define weak void @__gc_telemetry_record(i64 %kind, i64 %mark_ns, i64 %sweep_ns, i64 %promote_ns, i64 %bytes_before, i64 %bytes_after) {
+entry:
+  ret void
+}
+
+; Task result hooks called by gc.ll's mark and collect; the real ones are in
+; async_native.c, which the compiler's own link does not include either.
+define weak void @__sched_gc_note(i64 %val) {
+entry:
+  ret void
+}
+
+define weak void @__sched_gc_mark_results() {
+entry:
+  ret void
+}
+
+define weak void @__sched_gc_sweep_results() {
+entry:
+  ret void
+}
+
+; Weak references and ephemerons: no collector here, so nothing is ever
+; cleared. __gc_weak_supported returns 0 and src/lib/gc.sf keeps WeakRef and
+; WeakMap contents strongly instead of calling the rest of these.
+define weak i64 @__gc_weak_supported() {
+entry:
+  ret i64 0
+}
+
+define weak i8* @__gc_weak_new(i64 %target) {
+entry:
+  ret i8* null
+}
+
+define weak i64 @__gc_weak_get(i64 %cell) {
+entry:
+  ret i64 0
+}
+
+define weak i64 @__gc_weak_alive(i64 %cell) {
+entry:
+  ret i64 0
+}
+
+define weak i8* @__gc_ephemeron_new() {
+entry:
+  ret i8* null
+}
+
+define weak i64 @__gc_ephemeron_count(i64 %table) {
+entry:
+  ret i64 0
+}
+
+define weak i64 @__gc_ephemeron_capacity(i64 %table) {
+entry:
+  ret i64 0
+}
+
+define weak i64 @__gc_ephemeron_find(i64 %table, i64 %key) {
+entry:
+  ret i64 -1
+}
+
+define weak i64 @__gc_ephemeron_used(i64 %table, i64 %i) {
+entry:
+  ret i64 0
+}
+
+define weak i64 @__gc_ephemeron_key_at(i64 %table, i64 %i) {
+entry:
+  ret i64 0
+}
+
+define weak i64 @__gc_ephemeron_value_at(i64 %table, i64 %i) {
+entry:
+  ret i64 0
+}
+
+define weak void @__gc_ephemeron_set(i64 %table, i64 %key, i64 %val) {
+entry:
+  ret void
+}
+
+define weak i64 @__gc_ephemeron_remove(i64 %table, i64 %key) {
+entry:
+  ret i64 0
+}
+
 ; __gc_list_new: allocate a list using plain malloc.
 define weak i64 @__gc_list_new() {
 entry:
@@ -36,6 +36,14 @@ target triple = "arm64-apple-macosx14.0.0"
 @__gc_freed_bytes = global i64 0     ; total bytes freed
 @__gc_shadow_stack = global i64 0    ; pointer to shadow stack struct
 @__gc_shadow_stack_inited = global i64 0  ; 0=not inited, 1=inited
+@__gc_stacks = global i64 0          ; every thread's shadow stack struct, linked at +24
+
+; Heap profiler countdown (SAFFRON_HEAP_PROFILE, src/runtime/heapprof_native.c):
+; bytes left until the next sampled allocation. Both allocators subtract each
+; request and take the sample path only when it goes negative; disabled, it
+; stays at INT64_MAX so that branch is never taken. A sampled object carries
+; bit 1 of its info word so the sweep can report it freed.
+@__gc_prof_countdown = global i64 9223372036854775807
 
 ; =============================================================================
 ; Generational GC — Nursery (Young Generation)
@@ -97,6 +105,13 @@ declare i8* @malloc(i64)
 declare i8* @realloc(i8*, i64)
 declare void @free(i8*)
 declare i64 @write(i32, i8*, i64)
+declare void @__heapprof_sample(i64, i64)
+declare void @__heapprof_free(i64, i64)
+declare i64 @clock_gettime_nsec_np(i32)
+declare void @__gc_telemetry_record(i64, i64, i64, i64, i64, i64)
+declare void @__sched_gc_note(i64)
+declare void @__sched_gc_mark_results()
+declare void @__sched_gc_sweep_results()
 
 ; =============================================================================
 ; Helper: pack info field
@@ -136,8 +151,23 @@ entry:
 
 ; =============================================================================
 ; Shadow Stack Management
-; Shadow stack struct: { count: i64 @0, capacity: i64 @8, data_ptr: i64 @16 }
+; Shadow stack struct: { count: i64 @0, capacity: i64 @8, data_ptr: i64 @16,
+;                        next: i64 @24, saved temp roots: data @32, count @40,
+;                        cap @48 }
 ; =============================================================================
+;
+; Each OS thread has its own shadow stack (and temp-root stack, below). Only the
+; thread holding the GRL (src/runtime/thread_native.c) runs managed code, so the
+; globals always describe that thread: sf_grl_unlock parks them in the thread's
+; struct with __gc_thread_detach, and sf_grl_lock puts them back with
+; __gc_thread_attach. Frame pushes and pops stay plain global accesses.
+;
+; Every struct is on the @__gc_stacks list, and the collector marks from all of
+; them. A thread that has dropped the GRL is blocked in a native call, so its
+; roots cannot change while it is parked: a GRL release point is a safepoint.
+; Before, every thread pushed onto the one process-wide stack, and a thread that
+; popped after another had pushed on top of it (the GRL is dropped across join,
+; sleep and lock waits) removed the other thread's roots.
 
 define void @__gc_init_shadow_stack() {
 entry:
@@ -146,8 +176,8 @@ entry:
   br i1 %is_inited, label %done, label %init
 
 init:
-  ; Allocate shadow stack struct (24 bytes)
-  %ss_raw = call i8* @__sf_malloc_nogc(i64 24)
+  ; Allocate shadow stack struct (56 bytes)
+  %ss_raw = call i8* @__sf_malloc_nogc(i64 56)
   %ss = ptrtoint i8* %ss_raw to i64
   ; count = 0
   %ss_ptr = inttoptr i64 %ss to i64*
@@ -162,6 +192,22 @@ init:
   %data_addr = add i64 %ss, 16
   %data_ptr = inttoptr i64 %data_addr to i64*
   store i64 %data, i64* %data_ptr
+  ; No saved temp roots: they live in the globals while the thread runs
+  %st_data_addr = add i64 %ss, 32
+  %st_data_ptr = inttoptr i64 %st_data_addr to i64*
+  store i64 0, i64* %st_data_ptr
+  %st_count_addr = add i64 %ss, 40
+  %st_count_ptr = inttoptr i64 %st_count_addr to i64*
+  store i64 0, i64* %st_count_ptr
+  %st_cap_addr = add i64 %ss, 48
+  %st_cap_ptr = inttoptr i64 %st_cap_addr to i64*
+  store i64 0, i64* %st_cap_ptr
+  ; Link onto the list of every thread's stack
+  %head = load i64, i64* @__gc_stacks
+  %next_addr = add i64 %ss, 24
+  %next_ptr = inttoptr i64 %next_addr to i64*
+  store i64 %head, i64* %next_ptr
+  store i64 %ss, i64* @__gc_stacks
   ; Store shadow stack pointer and mark as inited
   store i64 %ss, i64* @__gc_shadow_stack
   store i64 1, i64* @__gc_shadow_stack_inited
@@ -320,6 +366,9 @@ entry:
   br i1 %need_init, label %do_init, label %check_grow
 
 do_init:
+  ; Make sure this thread has a struct on @__gc_stacks, or a collection on
+  ; another thread would not see these roots while this one is parked.
+  call void @__gc_init_shadow_stack()
   %init_bytes = mul i64 256, 8
   %init_raw = call i8* @__sf_malloc_nogc(i64 %init_bytes)
   %init_ptr = ptrtoint i8* %init_raw to i64
@@ -392,6 +441,134 @@ entry:
   ret void
 }
 
+; =============================================================================
+; Per-thread Root Switching (GRL handoff, src/runtime/thread_native.c)
+; =============================================================================
+
+; Park the running thread's roots in its stack struct and clear the globals for
+; the next GRL holder. Returns the struct (0 if the thread never made one), which
+; the caller hands back to __gc_thread_attach.
+define i64 @__gc_thread_detach() {
+entry:
+  %ss = load i64, i64* @__gc_shadow_stack
+  %none = icmp eq i64 %ss, 0
+  br i1 %none, label %clear, label %save
+
+save:
+  %t_data = load i64, i64* @__gc_temp_roots
+  %t_count = load i64, i64* @__gc_temp_count
+  %t_cap = load i64, i64* @__gc_temp_cap
+  %d_addr = add i64 %ss, 32
+  %d_ptr = inttoptr i64 %d_addr to i64*
+  store i64 %t_data, i64* %d_ptr
+  %c_addr = add i64 %ss, 40
+  %c_ptr = inttoptr i64 %c_addr to i64*
+  store i64 %t_count, i64* %c_ptr
+  %k_addr = add i64 %ss, 48
+  %k_ptr = inttoptr i64 %k_addr to i64*
+  store i64 %t_cap, i64* %k_ptr
+  br label %clear
+
+clear:
+  store i64 0, i64* @__gc_shadow_stack
+  store i64 0, i64* @__gc_shadow_stack_inited
+  store i64 0, i64* @__gc_temp_roots
+  store i64 0, i64* @__gc_temp_count
+  store i64 0, i64* @__gc_temp_cap
+  ret i64 %ss
+}
+
+; Make `ss` (from __gc_thread_detach) the running thread's roots again. 0 is a
+; no-op: a thread attaching for the first time finds the globals cleared by the
+; previous holder and makes its struct on its first push — except the main
+; thread, whose roots are already in the globals when it first takes the GRL.
+define void @__gc_thread_attach(i64 %ss) {
+entry:
+  %none = icmp eq i64 %ss, 0
+  br i1 %none, label %done, label %restore
+
+restore:
+  %d_addr = add i64 %ss, 32
+  %d_ptr = inttoptr i64 %d_addr to i64*
+  %t_data = load i64, i64* %d_ptr
+  %c_addr = add i64 %ss, 40
+  %c_ptr = inttoptr i64 %c_addr to i64*
+  %t_count = load i64, i64* %c_ptr
+  %k_addr = add i64 %ss, 48
+  %k_ptr = inttoptr i64 %k_addr to i64*
+  %t_cap = load i64, i64* %k_ptr
+  store i64 %t_data, i64* @__gc_temp_roots
+  store i64 %t_count, i64* @__gc_temp_count
+  store i64 %t_cap, i64* @__gc_temp_cap
+  store i64 %ss, i64* @__gc_shadow_stack
+  store i64 1, i64* @__gc_shadow_stack_inited
+  br label %done
+
+done:
+  ret void
+}
+
+; The running thread is finishing: take its struct off @__gc_stacks, free it,
+; and clear the globals. Called with the GRL held, just before the final release.
+define void @__gc_thread_exit() {
+entry:
+  %ss = load i64, i64* @__gc_shadow_stack
+  %none = icmp eq i64 %ss, 0
+  br i1 %none, label %clear, label %find
+
+find:
+  %next_addr = add i64 %ss, 24
+  %next_ptr = inttoptr i64 %next_addr to i64*
+  %next = load i64, i64* %next_ptr
+  %head = load i64, i64* @__gc_stacks
+  %at_head = icmp eq i64 %head, %ss
+  br i1 %at_head, label %unlink_head, label %walk
+
+unlink_head:
+  store i64 %next, i64* @__gc_stacks
+  br label %release
+
+walk:
+  %prev = phi i64 [%head, %find], [%cur, %walk_step]
+  %prev_none = icmp eq i64 %prev, 0
+  br i1 %prev_none, label %release, label %walk_check
+
+walk_check:
+  %prev_next_addr = add i64 %prev, 24
+  %prev_next_ptr = inttoptr i64 %prev_next_addr to i64*
+  %cur = load i64, i64* %prev_next_ptr
+  %found = icmp eq i64 %cur, %ss
+  br i1 %found, label %unlink, label %walk_step
+
+walk_step:
+  br label %walk
+
+unlink:
+  store i64 %next, i64* %prev_next_ptr
+  br label %release
+
+release:
+  %data_addr = add i64 %ss, 16
+  %data_ptr = inttoptr i64 %data_addr to i64*
+  %data = load i64, i64* %data_ptr
+  %data_raw = inttoptr i64 %data to i8*
+  call void @__sf_free(i8* %data_raw)
+  %t_data = load i64, i64* @__gc_temp_roots
+  %t_raw = inttoptr i64 %t_data to i8*
+  call void @__sf_free(i8* %t_raw)
+  %ss_raw = inttoptr i64 %ss to i8*
+  call void @__sf_free(i8* %ss_raw)
+  br label %clear
+
+clear:
+  store i64 0, i64* @__gc_shadow_stack
+  store i64 0, i64* @__gc_shadow_stack_inited
+  store i64 0, i64* @__gc_temp_roots
+  store i64 0, i64* @__gc_temp_count
+  store i64 0, i64* @__gc_temp_cap
+  ret void
+}
+
 ; =============================================================================
 ; GC Allocation
 ; =============================================================================
@@ -534,6 +711,18 @@ init_header:
   store i64 %tb_new, i64* @__gc_total_bytes
   ; Return user pointer = raw + 24
   %user = add i64 %raw, 24
+  ; Heap profiler: one never-taken branch unless SAFFRON_HEAP_PROFILE is set.
+  %prof_cd = load i64, i64* @__gc_prof_countdown
+  %prof_cd_new = sub i64 %prof_cd, %size
+  store i64 %prof_cd_new, i64* @__gc_prof_countdown
+  %prof_take = icmp slt i64 %prof_cd_new, 0
+  br i1 %prof_take, label %prof_sample, label %done
+
+prof_sample:
+  call void @__heapprof_sample(i64 %user, i64 %size)
+  br label %done
+
+done:
   ret i64 %user
 
 fail:
@@ -577,6 +766,18 @@ init_header:
   store i64 %tb_new, i64* @__gc_total_bytes
   ; Return user pointer = raw + 24
   %user = add i64 %raw, 24
+  ; Heap profiler: one never-taken branch unless SAFFRON_HEAP_PROFILE is set.
+  %prof_cd = load i64, i64* @__gc_prof_countdown
+  %prof_cd_new = sub i64 %prof_cd, %size
+  store i64 %prof_cd_new, i64* @__gc_prof_countdown
+  %prof_take = icmp slt i64 %prof_cd_new, 0
+  br i1 %prof_take, label %prof_sample, label %done
+
+prof_sample:
+  call void @__heapprof_sample(i64 %user, i64 %size)
+  br label %done
+
+done:
   ret i64 %user
 
 fail:
@@ -831,6 +1032,32 @@ no:
   ret i64 0
 }
 
+; A value the mark phase reached that is not a GC object. Task handles are raw
+; coroutine frame addresses, not GC objects, so this is how the collector learns
+; which finished tasks a program can still await: anything shaped like an
+; untagged pointer goes to __sched_gc_note (async_native.c), which flags the
+; task's result block as seen. Tagged Ints, nil and small integers fail the
+; shape test here and cost no call.
+define private void @__gc_note_foreign(i64 %val) {
+entry:
+  %align_bits = and i64 %val, 7
+  %aligned = icmp eq i64 %align_bits, 0
+  br i1 %aligned, label %check_range, label %done
+
+check_range:
+  %high_enough = icmp uge i64 %val, 4294967296   ; 0x100000000
+  %low_enough = icmp ule i64 %val, 281474976710655  ; 0x0000FFFFFFFFFFFF
+  %in_range = and i1 %high_enough, %low_enough
+  br i1 %in_range, label %note, label %done
+
+note:
+  call void @__sched_gc_note(i64 %val)
+  br label %done
+
+done:
+  ret void
+}
+
 ; Mark a single object: validate, set mark bit, push onto worklist.
 ; Does NOT recurse — children are processed by __gc_mark_drain.
 ;
@@ -850,7 +1077,13 @@ entry:
 validate:
   %is_heap = call i64 @__gc_is_heap_ptr(i64 %user_ptr)
   %not_heap = icmp eq i64 %is_heap, 0
-  br i1 %not_heap, label %done, label %check_marked
+  br i1 %not_heap, label %foreign, label %check_marked
+
+foreign:
+  ; Not ours, but it may be a Task handle (a raw coroutine frame address):
+  ; tell the scheduler its result is still reachable.
+  call void @__gc_note_foreign(i64 %user_ptr)
+  br label %done
 
 check_marked:
   %header = sub i64 %user_ptr, 24
@@ -1035,17 +1268,11 @@ done:
   ret void
 }
 
-; Mark phase: scan all roots from shadow stack, then drain the worklist
-define private void @__gc_mark() {
+; Mark one thread's roots: its shadow stack, then its temp roots. The running
+; thread's temp roots are in the globals; a parked thread's were saved in its
+; struct by __gc_thread_detach.
+define private void @__gc_mark_thread_roots(i64 %ss) {
 entry:
-  ; Reset mark stack count (reuse existing allocation)
-  store i64 0, i64* @__gc_mark_stack_count
-  %inited = load i64, i64* @__gc_shadow_stack_inited
-  %not_inited = icmp eq i64 %inited, 0
-  br i1 %not_inited, label %drain, label %scan
-
-scan:
-  %ss = load i64, i64* @__gc_shadow_stack
   %count_ptr = inttoptr i64 %ss to i64*
   %count = load i64, i64* %count_ptr
   %data_addr = add i64 %ss, 16
@@ -1054,9 +1281,9 @@ scan:
   br label %loop
 
 loop:
-  %i = phi i64 [0, %scan], [%i_next, %next]
+  %i = phi i64 [0, %entry], [%i_next, %next]
   %loop_done = icmp uge i64 %i, %count
-  br i1 %loop_done, label %drain, label %loop_body
+  br i1 %loop_done, label %temps, label %loop_body
 
 loop_body:
   ; Each entry is the address of a variable. Read the value at that address.
@@ -1077,19 +1304,27 @@ next:
   %i_next = add i64 %i, 1
   br label %loop
 
-drain:
+temps:
   ; Temp roots (BUGS #162): these entries are VALUES, not addresses, so they are
-  ; marked directly rather than dereferenced. Scanned before the drain so their
-  ; children are traced by the same worklist pass.
-  %t_count = load i64, i64* @__gc_temp_count
-  %t_data = load i64, i64* @__gc_temp_roots
-  %t_empty = icmp eq i64 %t_count, 0
-  br i1 %t_empty, label %do_drain, label %t_loop
+  ; marked directly rather than dereferenced.
+  %running = load i64, i64* @__gc_shadow_stack
+  %is_running = icmp eq i64 %running, %ss
+  %g_count = load i64, i64* @__gc_temp_count
+  %g_data = load i64, i64* @__gc_temp_roots
+  %s_count_addr = add i64 %ss, 40
+  %s_count_ptr = inttoptr i64 %s_count_addr to i64*
+  %s_count = load i64, i64* %s_count_ptr
+  %s_data_addr = add i64 %ss, 32
+  %s_data_ptr = inttoptr i64 %s_data_addr to i64*
+  %s_data = load i64, i64* %s_data_ptr
+  %t_count = select i1 %is_running, i64 %g_count, i64 %s_count
+  %t_data = select i1 %is_running, i64 %g_data, i64 %s_data
+  br label %t_loop
 
 t_loop:
-  %ti = phi i64 [0, %drain], [%ti_next, %t_body]
+  %ti = phi i64 [0, %temps], [%ti_next, %t_body]
   %t_done = icmp uge i64 %ti, %t_count
-  br i1 %t_done, label %do_drain, label %t_body
+  br i1 %t_done, label %done, label %t_body
 
 t_body:
   %t_off = shl i64 %ti, 3
@@ -1100,7 +1335,35 @@ t_body:
   %ti_next = add i64 %ti, 1
   br label %t_loop
 
+done:
+  ret void
+}
+
+; Mark phase: scan every thread's roots, then drain the worklist
+define private void @__gc_mark() {
+entry:
+  ; Reset mark stack count (reuse existing allocation)
+  store i64 0, i64* @__gc_mark_stack_count
+  %head = load i64, i64* @__gc_stacks
+  br label %stacks
+
+stacks:
+  %ss = phi i64 [%head, %entry], [%ss_next, %stack_body]
+  %stacks_done = icmp eq i64 %ss, 0
+  br i1 %stacks_done, label %do_drain, label %stack_body
+
+stack_body:
+  ; Scanned before the drain so every root's children are traced by the same
+  ; worklist pass.
+  call void @__gc_mark_thread_roots(i64 %ss)
+  %link_addr = add i64 %ss, 24
+  %link_ptr = inttoptr i64 %link_addr to i64*
+  %ss_next = load i64, i64* %link_ptr
+  br label %stacks
+
 do_drain:
+  ; Finished tasks' results are roots while their blocks hold them.
+  call void @__sched_gc_mark_results()
   ; After all roots are pushed, iteratively process the worklist
   call void @__gc_mark_drain()
   br label %done
@@ -1169,6 +1432,17 @@ do_free:
   %fb = load i64, i64* @__gc_freed_bytes
   %fb_new = add i64 %fb, %total_free
   store i64 %fb_new, i64* @__gc_freed_bytes
+  ; Sampled by the heap profiler? (info bit 1, see @__gc_prof_countdown)
+  %prof_bit = and i64 %info, 2
+  %prof_sampled = icmp ne i64 %prof_bit, 0
+  br i1 %prof_sampled, label %prof_free, label %release
+
+prof_free:
+  %prof_user = add i64 %current, 24
+  call void @__heapprof_free(i64 %prof_user, i64 %size)
+  br label %release
+
+release:
   ; Free the memory
   %free_ptr = inttoptr i64 %current to i8*
   call void @__sf_free(i8* %free_ptr)
@@ -1189,18 +1463,780 @@ done:
   ret void
 }
 
+; =============================================================================
+; Weak References and Ephemerons
+; =============================================================================
+;
+; A weak cell is a 16-byte tag-0 object { target@0, alive@8 }. Tag 0 is never
+; traced, so holding a cell does not keep its target alive. An ephemeron table
+; is a 24-byte tag-0 object { count@0, capacity@8, slots@16 }, where `slots` is
+; a tag-0 array of `capacity` 24-byte entries { used@0, key@8, value@16 } kept
+; as an open-addressed, linearly-probed hash on the key's identity. A value is
+; retained only while its key is reachable from somewhere other than the table
+; itself — which is the whole point for memoization caches, where the cached
+; value routinely points back at its own key and a strong map would pin both
+; forever.
+;
+; Neither shape can be recognised by walking @__gc_head (tag 0 means "opaque"
+; and every tag >= 10 belongs to a class), so each cell and table is recorded
+; in a malloc'd registry when it is created. @__gc_weak_process runs between
+; mark and sweep:
+;
+;   1. Ephemeron fixpoint. For every marked table, mark its slots array and the
+;      value of every entry whose key is marked, then drain. A value marked
+;      this way can make a key in another table live (or make a whole table
+;      reachable), so repeat until a pass pushes nothing onto the worklist.
+;   2. Clear. Weak cells whose target stayed unmarked are reset to dead; table
+;      entries whose key stayed unmarked are deleted (backward-shift, so no
+;      tombstones). Registry slots for cells and tables that are themselves
+;      about to be swept are dropped, as are cells already cleared.
+;
+; Keys and targets that are not heap objects (Ints, Floats, Bools, nil) are
+; always live. Keys compare by identity after TAG_PTR is stripped — two equal
+; strings built separately are two different keys. The collector never moves
+; objects (see the nursery section), so an address hash stays valid for the
+; lifetime of the key.
+
+@__gc_weak_cells = private global i64 0        ; i64 array of raw cell pointers
+@__gc_weak_cells_count = private global i64 0
+@__gc_weak_cells_cap = private global i64 0
+@__gc_ephemerons = private global i64 0        ; i64 array of raw table pointers
+@__gc_ephemerons_count = private global i64 0
+@__gc_ephemerons_cap = private global i64 0
+
+; Append a raw pointer to one of the registries above. The registries live
+; outside the GC heap (malloc'd via __sf_malloc_nogc) so they never keep what
+; they list alive.
+define private void @__gc_registry_push(i64* %data_g, i64* %count_g, i64* %cap_g, i64 %val) {
+entry:
+  %count = load i64, i64* %count_g
+  %cap = load i64, i64* %cap_g
+  %full = icmp uge i64 %count, %cap
+  br i1 %full, label %grow, label %push
+
+grow:
+  %cap_zero = icmp eq i64 %cap, 0
+  %doubled = shl i64 %cap, 1
+  %new_cap = select i1 %cap_zero, i64 64, i64 %doubled
+  %new_bytes = shl i64 %new_cap, 3
+  %old = load i64, i64* %data_g
+  %old_raw = inttoptr i64 %old to i8*
+  %new_raw = call i8* @__sf_realloc_nogc(i8* %old_raw, i64 %new_bytes)
+  %new = ptrtoint i8* %new_raw to i64
+  %grow_ok = icmp ne i64 %new, 0
+  br i1 %grow_ok, label %grown, label %oom
+
+grown:
+  store i64 %new, i64* %data_g
+  store i64 %new_cap, i64* %cap_g
+  br label %push
+
+push:
+  %data = load i64, i64* %data_g
+  %off = shl i64 %count, 3
+  %slot_addr = add i64 %data, %off
+  %slot_ptr = inttoptr i64 %slot_addr to i64*
+  store i64 %val, i64* %slot_ptr
+  %count_new = add i64 %count, 1
+  store i64 %count_new, i64* %count_g
+  ret void
+
+oom:
+  call void @__mem_oom_fail()
+  unreachable
+}
+
+; 1 if %val is not a heap object or is a marked one; 0 if it is an unmarked
+; heap object (i.e. it will be swept unless something marks it).
+define private i64 @__gc_weak_is_live(i64 %val) {
+entry:
+  %ptr = call i64 @__gc_strip_tag(i64 %val)
+  %is_heap = call i64 @__gc_is_heap_ptr(i64 %ptr)
+  %not_heap = icmp eq i64 %is_heap, 0
+  br i1 %not_heap, label %live, label %check_mark
+
+check_mark:
+  %info_addr = sub i64 %ptr, 16
+  %info_ptr = inttoptr i64 %info_addr to i64*
+  %info = load i64, i64* %info_ptr
+  %mark = call i64 @__gc_info_mark(i64 %info)
+  ret i64 %mark
+
+live:
+  ret i64 1
+}
+
+; Home slot of a key: Fibonacci hash of the untagged bits, masked to capacity.
+define private i64 @__gc_eph_home(i64 %key, i64 %mask) {
+entry:
+  %raw = call i64 @__gc_strip_tag(i64 %key)
+  %h1 = mul i64 %raw, -7046029254386353131     ; 0x9E3779B97F4A7C15
+  %h2 = lshr i64 %h1, 32
+  %h3 = xor i64 %h1, %h2
+  %idx = and i64 %h3, %mask
+  ret i64 %idx
+}
+
+; Address of entry %i in a slots array.
+define private i64 @__gc_eph_slot(i64 %slots, i64 %i) {
+entry:
+  %off = mul i64 %i, 24
+  %addr = add i64 %slots, %off
+  ret i64 %addr
+}
+
+; Index of the entry holding %key, or -1.
+define private i64 @__gc_eph_lookup(i64 %table, i64 %key) {
+entry:
+  %cap_addr = add i64 %table, 8
+  %cap_ptr = inttoptr i64 %cap_addr to i64*
+  %cap = load i64, i64* %cap_ptr
+  %empty = icmp eq i64 %cap, 0
+  br i1 %empty, label %missing, label %start
+
+start:
+  %slots_addr = add i64 %table, 16
+  %slots_ptr = inttoptr i64 %slots_addr to i64*
+  %slots = load i64, i64* %slots_ptr
+  %mask = sub i64 %cap, 1
+  %want = call i64 @__gc_strip_tag(i64 %key)
+  %home = call i64 @__gc_eph_home(i64 %key, i64 %mask)
+  br label %probe
+
+probe:
+  %i = phi i64 [%home, %start], [%i_next, %next]
+  %e = call i64 @__gc_eph_slot(i64 %slots, i64 %i)
+  %used_ptr = inttoptr i64 %e to i64*
+  %used = load i64, i64* %used_ptr
+  %is_free = icmp eq i64 %used, 0
+  br i1 %is_free, label %missing, label %compare
+
+compare:
+  %k_addr = add i64 %e, 8
+  %k_ptr = inttoptr i64 %k_addr to i64*
+  %k = load i64, i64* %k_ptr
+  %k_raw = call i64 @__gc_strip_tag(i64 %k)
+  %hit = icmp eq i64 %k_raw, %want
+  br i1 %hit, label %found, label %next
+
+next:
+  %i_inc = add i64 %i, 1
+  %i_next = and i64 %i_inc, %mask
+  br label %probe
+
+found:
+  ret i64 %i
+
+missing:
+  ret i64 -1
+}
+
+; Store (key, value) in the first free slot of its probe sequence. The caller
+; guarantees the key is absent and that a free slot exists.
+define private void @__gc_eph_insert_raw(i64 %slots, i64 %mask, i64 %key, i64 %val) {
+entry:
+  %home = call i64 @__gc_eph_home(i64 %key, i64 %mask)
+  br label %probe
+
+probe:
+  %i = phi i64 [%home, %entry], [%i_next, %probe]
+  %e = call i64 @__gc_eph_slot(i64 %slots, i64 %i)
+  %used_ptr = inttoptr i64 %e to i64*
+  %used = load i64, i64* %used_ptr
+  %i_inc = add i64 %i, 1
+  %i_next = and i64 %i_inc, %mask
+  %is_free = icmp eq i64 %used, 0
+  br i1 %is_free, label %store, label %probe
+
+store:
+  store i64 1, i64* %used_ptr
+  %k_addr = add i64 %e, 8
+  %k_ptr = inttoptr i64 %k_addr to i64*
+  store i64 %key, i64* %k_ptr
+  %v_addr = add i64 %e, 16
+  %v_ptr = inttoptr i64 %v_addr to i64*
+  store i64 %val, i64* %v_ptr
+  ret void
+}
+
+; Delete entry %i with backward-shift so the probe chains stay unbroken without
+; tombstones. Later entries whose home slot does not lie cyclically in (hole, j]
+; are moved down into the hole. Entries only ever move into the slot being
+; vacated, so a caller scanning forward can re-examine index %i and miss nothing.
+define private void @__gc_eph_delete_at(i64 %table, i64 %i) {
+entry:
+  %cap_addr = add i64 %table, 8
+  %cap_ptr = inttoptr i64 %cap_addr to i64*
+  %cap = load i64, i64* %cap_ptr
+  %mask = sub i64 %cap, 1
+  %slots_addr = add i64 %table, 16
+  %slots_ptr = inttoptr i64 %slots_addr to i64*
+  %slots = load i64, i64* %slots_ptr
+  br label %scan
+
+scan:
+  %hole = phi i64 [%i, %entry], [%hole, %stay], [%j, %move]
+  %j_prev = phi i64 [%i, %entry], [%j, %stay], [%j, %move]
+  %j_inc = add i64 %j_prev, 1
+  %j = and i64 %j_inc, %mask
+  %ej = call i64 @__gc_eph_slot(i64 %slots, i64 %j)
+  %ej_used_ptr = inttoptr i64 %ej to i64*
+  %ej_used = load i64, i64* %ej_used_ptr
+  %ej_free = icmp eq i64 %ej_used, 0
+  br i1 %ej_free, label %clear, label %check_home
+
+check_home:
+  %ej_k_addr = add i64 %ej, 8
+  %ej_k_ptr = inttoptr i64 %ej_k_addr to i64*
+  %ej_k = load i64, i64* %ej_k_ptr
+  %home = call i64 @__gc_eph_home(i64 %ej_k, i64 %mask)
+  ; dist(home -> j) vs dist(hole -> j): the entry may move into the hole only
+  ; if the hole sits on its probe path, i.e. no further from home than j is.
+  %d_home = sub i64 %j, %home
+  %d_home_m = and i64 %d_home, %mask
+  %d_hole = sub i64 %j, %hole
+  %d_hole_m = and i64 %d_hole, %mask
+  %can_move = icmp uge i64 %d_home_m, %d_hole_m
+  br i1 %can_move, label %move, label %stay
+
+stay:
+  br label %scan
+
+move:
+  %eh = call i64 @__gc_eph_slot(i64 %slots, i64 %hole)
+  %eh_k_addr = add i64 %eh, 8
+  %eh_k_ptr = inttoptr i64 %eh_k_addr to i64*
+  store i64 %ej_k, i64* %eh_k_ptr
+  %ej_v_addr = add i64 %ej, 16
+  %ej_v_ptr = inttoptr i64 %ej_v_addr to i64*
+  %ej_v = load i64, i64* %ej_v_ptr
+  %eh_v_addr = add i64 %eh, 16
+  %eh_v_ptr = inttoptr i64 %eh_v_addr to i64*
+  store i64 %ej_v, i64* %eh_v_ptr
+  %eh_used_ptr = inttoptr i64 %eh to i64*
+  store i64 1, i64* %eh_used_ptr
+  br label %scan
+
+clear:
+  %ec = call i64 @__gc_eph_slot(i64 %slots, i64 %hole)
+  %ec_used_ptr = inttoptr i64 %ec to i64*
+  store i64 0, i64* %ec_used_ptr
+  %ec_k_addr = add i64 %ec, 8
+  %ec_k_ptr = inttoptr i64 %ec_k_addr to i64*
+  store i64 0, i64* %ec_k_ptr
+  %ec_v_addr = add i64 %ec, 16
+  %ec_v_ptr = inttoptr i64 %ec_v_addr to i64*
+  store i64 0, i64* %ec_v_ptr
+  %count_ptr = inttoptr i64 %table to i64*
+  %count = load i64, i64* %count_ptr
+  %count_new = sub i64 %count, 1
+  store i64 %count_new, i64* %count_ptr
+  ret void
+}
+
+; Between mark and sweep: ephemeron fixpoint, then clear dead weak cells and
+; ephemeron entries. See the section header.
+define private void @__gc_weak_process() {
+entry:
+  br label %pass
+
+; ── 1. Ephemeron fixpoint ────────────────────────────────────────────────────
+pass:
+  %n_tables = load i64, i64* @__gc_ephemerons_count
+  br label %table_loop
+
+table_loop:
+  %ti = phi i64 [0, %pass], [%ti_next, %table_next]
+  %tables_done = icmp uge i64 %ti, %n_tables
+  br i1 %tables_done, label %pass_end, label %table_body
+
+table_body:
+  %reg = load i64, i64* @__gc_ephemerons
+  %t_off = shl i64 %ti, 3
+  %t_slot_addr = add i64 %reg, %t_off
+  %t_slot_ptr = inttoptr i64 %t_slot_addr to i64*
+  %table = load i64, i64* %t_slot_ptr
+  %t_info_addr = sub i64 %table, 16
+  %t_info_ptr = inttoptr i64 %t_info_addr to i64*
+  %t_info = load i64, i64* %t_info_ptr
+  %t_mark = call i64 @__gc_info_mark(i64 %t_info)
+  %t_dead = icmp eq i64 %t_mark, 0
+  br i1 %t_dead, label %table_next, label %table_live
+
+table_live:
+  %slots_addr = add i64 %table, 16
+  %slots_ptr = inttoptr i64 %slots_addr to i64*
+  %slots = load i64, i64* %slots_ptr
+  call void @__gc_mark_object(i64 %slots)
+  %cap_addr = add i64 %table, 8
+  %cap_ptr = inttoptr i64 %cap_addr to i64*
+  %cap = load i64, i64* %cap_ptr
+  br label %entry_loop
+
+entry_loop:
+  %ei = phi i64 [0, %table_live], [%ei_next, %entry_next]
+  %entries_done = icmp uge i64 %ei, %cap
+  br i1 %entries_done, label %table_next, label %entry_body
+
+entry_body:
+  %e = call i64 @__gc_eph_slot(i64 %slots, i64 %ei)
+  %used_ptr = inttoptr i64 %e to i64*
+  %used = load i64, i64* %used_ptr
+  %is_free = icmp eq i64 %used, 0
+  br i1 %is_free, label %entry_next, label %entry_used
+
+entry_used:
+  %k_addr = add i64 %e, 8
+  %k_ptr = inttoptr i64 %k_addr to i64*
+  %k = load i64, i64* %k_ptr
+  %k_live = call i64 @__gc_weak_is_live(i64 %k)
+  %k_dead = icmp eq i64 %k_live, 0
+  br i1 %k_dead, label %entry_next, label %mark_value
+
+mark_value:
+  ; __gc_mark_object is a no-op for an already-marked value, so re-running
+  ; a pass over the same live entries pushes nothing and the loop terminates.
+  %v_addr = add i64 %e, 16
+  %v_ptr = inttoptr i64 %v_addr to i64*
+  %v = load i64, i64* %v_ptr
+  call void @__gc_mark_object(i64 %v)
+  br label %entry_next
+
+entry_next:
+  %ei_next = add i64 %ei, 1
+  br label %entry_loop
+
+table_next:
+  %ti_next = add i64 %ti, 1
+  br label %table_loop
+
+pass_end:
+  %pending = load i64, i64* @__gc_mark_stack_count
+  %settled = icmp eq i64 %pending, 0
+  br i1 %settled, label %clear_cells, label %drain
+
+drain:
+  call void @__gc_mark_drain()
+  br label %pass
+
+; ── 2a. Clear weak cells ─────────────────────────────────────────────────────
+clear_cells:
+  %n_cells = load i64, i64* @__gc_weak_cells_count
+  %cells = load i64, i64* @__gc_weak_cells
+  br label %cell_loop
+
+cell_loop:
+  %ci = phi i64 [0, %clear_cells], [%ci_next, %cell_drop], [%ci_next, %cell_keep]
+  %kept = phi i64 [0, %clear_cells], [%kept, %cell_drop], [%kept_next, %cell_keep]
+  %cells_done = icmp uge i64 %ci, %n_cells
+  br i1 %cells_done, label %cells_end, label %cell_body
+
+cell_body:
+  %c_off = shl i64 %ci, 3
+  %c_slot_addr = add i64 %cells, %c_off
+  %c_slot_ptr = inttoptr i64 %c_slot_addr to i64*
+  %cell = load i64, i64* %c_slot_ptr
+  %ci_next = add i64 %ci, 1
+  %c_info_addr = sub i64 %cell, 16
+  %c_info_ptr = inttoptr i64 %c_info_addr to i64*
+  %c_info = load i64, i64* %c_info_ptr
+  %c_mark = call i64 @__gc_info_mark(i64 %c_info)
+  %c_dead = icmp eq i64 %c_mark, 0
+  br i1 %c_dead, label %cell_drop, label %cell_check
+
+cell_check:
+  %target_ptr = inttoptr i64 %cell to i64*
+  %target = load i64, i64* %target_ptr
+  %target_live = call i64 @__gc_weak_is_live(i64 %target)
+  %target_dead = icmp eq i64 %target_live, 0
+  br i1 %target_dead, label %cell_clear, label %cell_keep
+
+cell_clear:
+  store i64 0, i64* %target_ptr
+  %alive_addr = add i64 %cell, 8
+  %alive_ptr = inttoptr i64 %alive_addr to i64*
+  store i64 0, i64* %alive_ptr
+  br label %cell_drop
+
+cell_drop:
+  br label %cell_loop
+
+cell_keep:
+  %k_off = shl i64 %kept, 3
+  %k_slot_addr = add i64 %cells, %k_off
+  %k_slot_ptr = inttoptr i64 %k_slot_addr to i64*
+  store i64 %cell, i64* %k_slot_ptr
+  %kept_next = add i64 %kept, 1
+  br label %cell_loop
+
+cells_end:
+  store i64 %kept, i64* @__gc_weak_cells_count
+  br label %clear_tables
+
+; ── 2b. Clear ephemeron entries with dead keys ───────────────────────────────
+clear_tables:
+  %n_tables2 = load i64, i64* @__gc_ephemerons_count
+  %reg2 = load i64, i64* @__gc_ephemerons
+  br label %ct_loop
+
+ct_loop:
+  %cti = phi i64 [0, %clear_tables], [%cti_next, %ct_drop], [%cti_next, %ct_keep]
+  %t_kept = phi i64 [0, %clear_tables], [%t_kept, %ct_drop], [%t_kept_next, %ct_keep]
+  %ct_done = icmp uge i64 %cti, %n_tables2
+  br i1 %ct_done, label %tables_end, label %ct_body
+
+ct_body:
+  %ct_off = shl i64 %cti, 3
+  %ct_slot_addr = add i64 %reg2, %ct_off
+  %ct_slot_ptr = inttoptr i64 %ct_slot_addr to i64*
+  %ct = load i64, i64* %ct_slot_ptr
+  %cti_next = add i64 %cti, 1
+  %ct_info_addr = sub i64 %ct, 16
+  %ct_info_ptr = inttoptr i64 %ct_info_addr to i64*
+  %ct_info = load i64, i64* %ct_info_ptr
+  %ct_mark = call i64 @__gc_info_mark(i64 %ct_info)
+  %ct_dead = icmp eq i64 %ct_mark, 0
+  br i1 %ct_dead, label %ct_drop, label %ct_scan
+
+ct_scan:
+  %ct_cap_addr = add i64 %ct, 8
+  %ct_cap_ptr = inttoptr i64 %ct_cap_addr to i64*
+  %ct_cap = load i64, i64* %ct_cap_ptr
+  %ct_slots_addr = add i64 %ct, 16
+  %ct_slots_ptr = inttoptr i64 %ct_slots_addr to i64*
+  br label %ce_loop
+
+ce_loop:
+  %cei = phi i64 [0, %ct_scan], [%cei, %ce_delete], [%cei_next, %ce_next]
+  %ce_done = icmp uge i64 %cei, %ct_cap
+  br i1 %ce_done, label %ct_keep, label %ce_body
+
+ce_body:
+  %ct_slots = load i64, i64* %ct_slots_ptr
+  %ce = call i64 @__gc_eph_slot(i64 %ct_slots, i64 %cei)
+  %ce_used_ptr = inttoptr i64 %ce to i64*
+  %ce_used = load i64, i64* %ce_used_ptr
+  %ce_free = icmp eq i64 %ce_used, 0
+  br i1 %ce_free, label %ce_next, label %ce_check
+
+ce_check:
+  %ce_k_addr = add i64 %ce, 8
+  %ce_k_ptr = inttoptr i64 %ce_k_addr to i64*
+  %ce_k = load i64, i64* %ce_k_ptr
+  %ce_k_live = call i64 @__gc_weak_is_live(i64 %ce_k)
+  %ce_k_dead = icmp eq i64 %ce_k_live, 0
+  br i1 %ce_k_dead, label %ce_delete, label %ce_next
+
+ce_delete:
+  ; Backward-shift may pull a later entry into %cei, so look at it again.
+  call void @__gc_eph_delete_at(i64 %ct, i64 %cei)
+  br label %ce_loop
+
+ce_next:
+  %cei_next = add i64 %cei, 1
+  br label %ce_loop
+
+ct_drop:
+  br label %ct_loop
+
+ct_keep:
+  %tk_off = shl i64 %t_kept, 3
+  %tk_slot_addr = add i64 %reg2, %tk_off
+  %tk_slot_ptr = inttoptr i64 %tk_slot_addr to i64*
+  store i64 %ct, i64* %tk_slot_ptr
+  %t_kept_next = add i64 %t_kept, 1
+  br label %ct_loop
+
+tables_end:
+  store i64 %t_kept, i64* @__gc_ephemerons_count
+  ret void
+}
+
+; Nonzero when this runtime clears weak references. The stub bases (no
+; collector linked) return 0 and src/lib/gc.sf falls back to strong storage.
+define i64 @__gc_weak_supported() {
+entry:
+  ret i64 1
+}
+
+; Create a weak cell pointing at %target. Allocated with __gc_alloc_safe so the
+; caller's unrooted %target cannot be collected out from under it here.
+define i8* @__gc_weak_new(i64 %target) {
+entry:
+  %cell = call i64 @__gc_alloc_safe(i64 16, i64 0)
+  %failed = icmp eq i64 %cell, 0
+  br i1 %failed, label %fail, label %init
+
+init:
+  %target_ptr = inttoptr i64 %cell to i64*
+  store i64 %target, i64* %target_ptr
+  %alive_addr = add i64 %cell, 8
+  %alive_ptr = inttoptr i64 %alive_addr to i64*
+  store i64 1, i64* %alive_ptr
+  call void @__gc_registry_push(i64* @__gc_weak_cells, i64* @__gc_weak_cells_count, i64* @__gc_weak_cells_cap, i64 %cell)
+  %r = inttoptr i64 %cell to i8*
+  ret i8* %r
+
+fail:
+  ret i8* null
+}
+
+; The cell's target. Only meaningful while __gc_weak_alive returns 1.
+define i64 @__gc_weak_get(i64 %cell_in) {
+entry:
+  %cell = call i64 @__gc_strip_tag(i64 %cell_in)
+  %target_ptr = inttoptr i64 %cell to i64*
+  %target = load i64, i64* %target_ptr
+  ret i64 %target
+}
+
+; 1 until a collection finds the target unreachable, then 0 forever.
+define i64 @__gc_weak_alive(i64 %cell_in) {
+entry:
+  %cell = call i64 @__gc_strip_tag(i64 %cell_in)
+  %alive_addr = add i64 %cell, 8
+  %alive_ptr = inttoptr i64 %alive_addr to i64*
+  %alive = load i64, i64* %alive_ptr
+  ret i64 %alive
+}
+
+; Create an empty ephemeron table. Slots are allocated on first insert.
+define i8* @__gc_ephemeron_new() {
+entry:
+  %table = call i64 @__gc_alloc_safe(i64 24, i64 0)
+  %failed = icmp eq i64 %table, 0
+  br i1 %failed, label %fail, label %init
+
+init:
+  %count_ptr = inttoptr i64 %table to i64*
+  store i64 0, i64* %count_ptr
+  %cap_addr = add i64 %table, 8
+  %cap_ptr = inttoptr i64 %cap_addr to i64*
+  store i64 0, i64* %cap_ptr
+  %slots_addr = add i64 %table, 16
+  %slots_ptr = inttoptr i64 %slots_addr to i64*
+  store i64 0, i64* %slots_ptr
+  call void @__gc_registry_push(i64* @__gc_ephemerons, i64* @__gc_ephemerons_count, i64* @__gc_ephemerons_cap, i64 %table)
+  %r = inttoptr i64 %table to i8*
+  ret i8* %r
+
+fail:
+  ret i8* null
+}
+
+define i64 @__gc_ephemeron_count(i64 %table_in) {
+entry:
+  %table = call i64 @__gc_strip_tag(i64 %table_in)
+  %count_ptr = inttoptr i64 %table to i64*
+  %count = load i64, i64* %count_ptr
+  ret i64 %count
+}
+
+; Number of slots; iterate 0..capacity and skip slots where
+; __gc_ephemeron_used is 0.
+define i64 @__gc_ephemeron_capacity(i64 %table_in) {
+entry:
+  %table = call i64 @__gc_strip_tag(i64 %table_in)
+  %cap_addr = add i64 %table, 8
+  %cap_ptr = inttoptr i64 %cap_addr to i64*
+  %cap = load i64, i64* %cap_ptr
+  ret i64 %cap
+}
+
+; Slot index holding %key, or -1.
+define i64 @__gc_ephemeron_find(i64 %table_in, i64 %key) {
+entry:
+  %table = call i64 @__gc_strip_tag(i64 %table_in)
+  %idx = call i64 @__gc_eph_lookup(i64 %table, i64 %key)
+  ret i64 %idx
+}
+
+define i64 @__gc_ephemeron_used(i64 %table_in, i64 %i) {
+entry:
+  %table = call i64 @__gc_strip_tag(i64 %table_in)
+  %slots_addr = add i64 %table, 16
+  %slots_ptr = inttoptr i64 %slots_addr to i64*
+  %slots = load i64, i64* %slots_ptr
+  %e = call i64 @__gc_eph_slot(i64 %slots, i64 %i)
+  %used_ptr = inttoptr i64 %e to i64*
+  %used = load i64, i64* %used_ptr
+  ret i64 %used
+}
+
+define i64 @__gc_ephemeron_key_at(i64 %table_in, i64 %i) {
+entry:
+  %table = call i64 @__gc_strip_tag(i64 %table_in)
+  %slots_addr = add i64 %table, 16
+  %slots_ptr = inttoptr i64 %slots_addr to i64*
+  %slots = load i64, i64* %slots_ptr
+  %e = call i64 @__gc_eph_slot(i64 %slots, i64 %i)
+  %k_addr = add i64 %e, 8
+  %k_ptr = inttoptr i64 %k_addr to i64*
+  %k = load i64, i64* %k_ptr
+  ret i64 %k
+}
+
+define i64 @__gc_ephemeron_value_at(i64 %table_in, i64 %i) {
+entry:
+  %table = call i64 @__gc_strip_tag(i64 %table_in)
+  %slots_addr = add i64 %table, 16
+  %slots_ptr = inttoptr i64 %slots_addr to i64*
+  %slots = load i64, i64* %slots_ptr
+  %e = call i64 @__gc_eph_slot(i64 %slots, i64 %i)
+  %v_addr = add i64 %e, 16
+  %v_ptr = inttoptr i64 %v_addr to i64*
+  %v = load i64, i64* %v_ptr
+  ret i64 %v
+}
+
+; Insert or overwrite. Grows (doubling, starting at 8 slots) once the table
+; would pass half full; the old slots array is left for the sweep. Uses
+; __gc_alloc_safe throughout: %key and %val are unrooted here.
+define void @__gc_ephemeron_set(i64 %table_in, i64 %key, i64 %val) {
+entry:
+  %table = call i64 @__gc_strip_tag(i64 %table_in)
+  %idx = call i64 @__gc_eph_lookup(i64 %table, i64 %key)
+  %present = icmp sge i64 %idx, 0
+  %slots_addr = add i64 %table, 16
+  %slots_ptr = inttoptr i64 %slots_addr to i64*
+  br i1 %present, label %overwrite, label %check_grow
+
+overwrite:
+  %slots_o = load i64, i64* %slots_ptr
+  %eo = call i64 @__gc_eph_slot(i64 %slots_o, i64 %idx)
+  %eo_v_addr = add i64 %eo, 16
+  %eo_v_ptr = inttoptr i64 %eo_v_addr to i64*
+  store i64 %val, i64* %eo_v_ptr
+  ret void
+
+check_grow:
+  %count_ptr = inttoptr i64 %table to i64*
+  %count = load i64, i64* %count_ptr
+  %cap_addr = add i64 %table, 8
+  %cap_ptr = inttoptr i64 %cap_addr to i64*
+  %cap = load i64, i64* %cap_ptr
+  %count1 = add i64 %count, 1
+  %need = shl i64 %count1, 1
+  %full = icmp ugt i64 %need, %cap
+  br i1 %full, label %grow, label %insert
+
+grow:
+  %cap_zero = icmp eq i64 %cap, 0
+  %doubled = shl i64 %cap, 1
+  %new_cap = select i1 %cap_zero, i64 8, i64 %doubled
+  %new_bytes = mul i64 %new_cap, 24
+  %new_slots = call i64 @__gc_alloc_safe(i64 %new_bytes, i64 0)
+  %alloc_failed = icmp eq i64 %new_slots, 0
+  br i1 %alloc_failed, label %oom, label %zero_loop
+
+zero_loop:
+  %zi = phi i64 [0, %grow], [%zi_next, %zero_body]
+  %zero_done = icmp uge i64 %zi, %new_cap
+  br i1 %zero_done, label %rehash, label %zero_body
+
+zero_body:
+  %ze = call i64 @__gc_eph_slot(i64 %new_slots, i64 %zi)
+  %ze_ptr = inttoptr i64 %ze to i64*
+  store i64 0, i64* %ze_ptr
+  %zi_next = add i64 %zi, 1
+  br label %zero_loop
+
+rehash:
+  %old_slots = load i64, i64* %slots_ptr
+  %new_mask = sub i64 %new_cap, 1
+  br label %rehash_loop
+
+rehash_loop:
+  %ri = phi i64 [0, %rehash], [%ri_next, %rehash_next]
+  %rehash_done = icmp uge i64 %ri, %cap
+  br i1 %rehash_done, label %install, label %rehash_body
+
+rehash_body:
+  %re = call i64 @__gc_eph_slot(i64 %old_slots, i64 %ri)
+  %re_used_ptr = inttoptr i64 %re to i64*
+  %re_used = load i64, i64* %re_used_ptr
+  %re_free = icmp eq i64 %re_used, 0
+  br i1 %re_free, label %rehash_next, label %rehash_move
+
+rehash_move:
+  %re_k_addr = add i64 %re, 8
+  %re_k_ptr = inttoptr i64 %re_k_addr to i64*
+  %re_k = load i64, i64* %re_k_ptr
+  %re_v_addr = add i64 %re, 16
+  %re_v_ptr = inttoptr i64 %re_v_addr to i64*
+  %re_v = load i64, i64* %re_v_ptr
+  call void @__gc_eph_insert_raw(i64 %new_slots, i64 %new_mask, i64 %re_k, i64 %re_v)
+  br label %rehash_next
+
+rehash_next:
+  %ri_next = add i64 %ri, 1
+  br label %rehash_loop
+
+install:
+  store i64 %new_slots, i64* %slots_ptr
+  store i64 %new_cap, i64* %cap_ptr
+  br label %insert
+
+insert:
+  %slots = load i64, i64* %slots_ptr
+  %cap_now = load i64, i64* %cap_ptr
+  %mask = sub i64 %cap_now, 1
+  call void @__gc_eph_insert_raw(i64 %slots, i64 %mask, i64 %key, i64 %val)
+  %count_now = load i64, i64* %count_ptr
+  %count_new = add i64 %count_now, 1
+  store i64 %count_new, i64* %count_ptr
+  ret void
+
+oom:
+  call void @__mem_oom_fail()
+  unreachable
+}
+
+; Remove %key. Returns 1 if it was present.
+define i64 @__gc_ephemeron_remove(i64 %table_in, i64 %key) {
+entry:
+  %table = call i64 @__gc_strip_tag(i64 %table_in)
+  %idx = call i64 @__gc_eph_lookup(i64 %table, i64 %key)
+  %missing = icmp slt i64 %idx, 0
+  br i1 %missing, label %no, label %remove
+
+remove:
+  call void @__gc_eph_delete_at(i64 %table, i64 %idx)
+  ret i64 1
+
+no:
+  ret i64 0
+}
+
 ; =============================================================================
 ; Public API
 ; =============================================================================
 
 ; Run a full mark-and-sweep collection
+;
+; Each phase is timed with the monotonic raw clock (4 = CLOCK_MONOTONIC_RAW on
+; Darwin) and handed to @__gc_telemetry_record (gctrace_native.c) along with the
+; heap size before and after, which feeds GC.telemetry() and SAFFRON_GC_TRACE.
+; The ephemeron fixpoint is marking work, so it is charged to the mark phase.
 define i64 @__gc_collect() {
 entry:
+  %t0 = call i64 @clock_gettime_nsec_np(i32 4)
+  %bytes_before = load i64, i64* @__gc_total_bytes
   call void @__gc_mark()
+  call void @__gc_weak_process()
+  ; Every Task value the program holds has now been seen; release the result
+  ; blocks of finished tasks it no longer holds.
+  call void @__sched_gc_sweep_results()
+  %t1 = call i64 @clock_gettime_nsec_np(i32 4)
   call void @__gc_sweep_impl()
+  %t2 = call i64 @clock_gettime_nsec_np(i32 4)
+  %bytes_after = load i64, i64* @__gc_total_bytes
   %c = load i64, i64* @__gc_collections
   %c_new = add i64 %c, 1
   store i64 %c_new, i64* @__gc_collections
+  %mark_ns = sub i64 %t1, %t0
+  %sweep_ns = sub i64 %t2, %t1
+  call void @__gc_telemetry_record(i64 0, i64 %mark_ns, i64 %sweep_ns, i64 0, i64 %bytes_before, i64 %bytes_after)
   ret i64 0
 }
 
@@ -1680,6 +2716,13 @@ entry:
   br i1 %not_inited, label %done, label %begin
 
 begin:
+  ; Telemetry: mark = phases 1/1b, promote = phases 2-3b. The nursery's fill
+  ; level is the "before" figure and the old generation's growth across
+  ; promotion the "after", so after/before is the promotion rate.
+  %t0 = call i64 @clock_gettime_nsec_np(i32 4)
+  %n_start0 = load i64, i64* @__gc_nursery_start
+  %n_ptr0 = load i64, i64* @__gc_nursery_ptr
+  %nursery_used = sub i64 %n_ptr0, %n_start0
   ; Phase 1: Mark nursery objects reachable from roots
   call void @__gc_minor_mark_roots()
   ; Phase 1b: ...and from the old generation. The remembered set that phase 1
@@ -1687,6 +2730,8 @@ begin:
   ; this an old-gen -> nursery edge is missed entirely. See BUGS #81 and the
   ; commentary on __gc_minor_scan_old_gen. mode 0 = mark.
   call void @__gc_minor_scan_old_gen(i64 0)
+  %t1 = call i64 @clock_gettime_nsec_np(i32 4)
+  %old_before = load i64, i64* @__gc_total_bytes
   ; Phase 2: Promote marked nursery objects, install forwarding pointers
   call void @__gc_minor_promote()
   ; Phase 3: Update all references to point to new old-gen locations
@@ -1695,6 +2740,8 @@ begin:
   ; while the forwarding pointers are still readable, i.e. before phase 4
   ; resets the bump pointer. mode 1 = forward.
   call void @__gc_minor_scan_old_gen(i64 1)
+  %t2 = call i64 @clock_gettime_nsec_np(i32 4)
+  %old_after = load i64, i64* @__gc_total_bytes
   ; Phase 4: Reset nursery bump pointer
   %start = load i64, i64* @__gc_nursery_start
   store i64 %start, i64* @__gc_nursery_ptr
@@ -1704,32 +2751,43 @@ begin:
   %mc = load i64, i64* @__gc_minor_collections
   %mc_new = add i64 %mc, 1
   store i64 %mc_new, i64* @__gc_minor_collections
+  %mark_ns = sub i64 %t1, %t0
+  %promote_ns = sub i64 %t2, %t1
+  %promoted = sub i64 %old_after, %old_before
+  call void @__gc_telemetry_record(i64 1, i64 %mark_ns, i64 0, i64 %promote_ns, i64 %nursery_used, i64 %promoted)
   br label %done
 
 done:
   ret void
 }
 
-; Mark nursery objects reachable from shadow stack and remembered set
+; Mark nursery objects reachable from every thread's shadow stack and the
+; remembered set
 define private void @__gc_minor_mark_roots() optnone noinline {
 entry:
-  %ss_inited = load i64, i64* @__gc_shadow_stack_inited
-  %not_inited = icmp eq i64 %ss_inited, 0
-  br i1 %not_inited, label %scan_remembered, label %scan_roots
+  %head = load i64, i64* @__gc_stacks
+  br label %stacks
+
+stacks:
+  %ss = phi i64 [%head, %entry], [%ss_next, %root_loop]
+  %stacks_done = icmp eq i64 %ss, 0
+  br i1 %stacks_done, label %scan_remembered, label %scan_roots
 
 scan_roots:
-  %ss = load i64, i64* @__gc_shadow_stack
   %count_ptr = inttoptr i64 %ss to i64*
   %count = load i64, i64* %count_ptr
   %data_addr = add i64 %ss, 16
   %data_ptr = inttoptr i64 %data_addr to i64*
   %data = load i64, i64* %data_ptr
+  %link_addr = add i64 %ss, 24
+  %link_ptr = inttoptr i64 %link_addr to i64*
+  %ss_next = load i64, i64* %link_ptr
   br label %root_loop
 
 root_loop:
   %ri = phi i64 [0, %scan_roots], [%ri_next, %root_next]
   %root_done = icmp uge i64 %ri, %count
-  br i1 %root_done, label %scan_remembered, label %root_body
+  br i1 %root_done, label %stacks, label %root_body
 
 root_body:
   %slot_offset = shl i64 %ri, 3
@@ -2386,24 +3444,30 @@ done:
 ; Update all references that point to forwarded nursery objects
 define private void @__gc_minor_update_refs() optnone noinline {
 entry:
-  ; 1. Update shadow stack roots
-  %ss_inited = load i64, i64* @__gc_shadow_stack_inited
-  %no_ss = icmp eq i64 %ss_inited, 0
-  br i1 %no_ss, label %update_promoted, label %update_roots
+  ; 1. Update every thread's shadow stack roots
+  %head = load i64, i64* @__gc_stacks
+  br label %stacks
+
+stacks:
+  %ss = phi i64 [%head, %entry], [%ss_next, %root_loop]
+  %stacks_done = icmp eq i64 %ss, 0
+  br i1 %stacks_done, label %update_promoted, label %update_roots
 
 update_roots:
-  %ss = load i64, i64* @__gc_shadow_stack
   %count_ptr = inttoptr i64 %ss to i64*
   %count = load i64, i64* %count_ptr
   %data_addr = add i64 %ss, 16
   %data_ptr = inttoptr i64 %data_addr to i64*
   %data = load i64, i64* %data_ptr
+  %link_addr = add i64 %ss, 24
+  %link_ptr = inttoptr i64 %link_addr to i64*
+  %ss_next = load i64, i64* %link_ptr
   br label %root_loop
 
 root_loop:
   %ri = phi i64 [0, %update_roots], [%ri_next, %root_next]
   %root_done = icmp uge i64 %ri, %count
-  br i1 %root_done, label %update_promoted, label %root_body
+  br i1 %root_done, label %stacks, label %root_body
 
 root_body:
   %slot_offset = shl i64 %ri, 3
@@ -2579,6 +3643,56 @@ done:
   ret void
 }
 
+; Halve the nursery under memory pressure (see __mem_pressure_collect), down to
+; 64KB. The arena is not reallocated: its end is pulled in — never below the
+; bump pointer, so every live nursery object stays inside [start, end) — and
+; the whole pages past the new end are handed back with madvise(MADV_DONTNEED).
+; The arena never grows back; __gc_set_nursery_size() does that explicitly.
+define private void @__gc_nursery_shrink() {
+entry:
+  %inited = load i64, i64* @__gc_nursery_inited
+  %is_inited = icmp ne i64 %inited, 0
+  br i1 %is_inited, label %check_size, label %done
+
+check_size:
+  %size = load i64, i64* @__gc_nursery_size
+  %half = lshr i64 %size, 1
+  %too_small = icmp ult i64 %half, 65536
+  br i1 %too_small, label %done, label %shrink
+
+shrink:
+  store i64 %half, i64* @__gc_nursery_size
+  %start = load i64, i64* @__gc_nursery_start
+  %ptr = load i64, i64* @__gc_nursery_ptr
+  %end = load i64, i64* @__gc_nursery_end
+  %want = add i64 %start, %half
+  %below_ptr = icmp ult i64 %want, %ptr
+  %new_end = select i1 %below_ptr, i64 %ptr, i64 %want
+  %shrinks = icmp ult i64 %new_end, %end
+  br i1 %shrinks, label %set_end, label %done
+
+set_end:
+  store i64 %new_end, i64* @__gc_nursery_end
+  %page32 = call i32 @getpagesize()
+  %page = sext i32 %page32 to i64
+  %mask = sub i64 0, %page
+  %lo_up = add i64 %new_end, %page
+  %lo_up1 = sub i64 %lo_up, 1
+  %lo = and i64 %lo_up1, %mask
+  %hi = and i64 %end, %mask
+  %has_pages = icmp ult i64 %lo, %hi
+  br i1 %has_pages, label %release, label %done
+
+release:
+  %len = sub i64 %hi, %lo
+  %lo_ptr = inttoptr i64 %lo to i8*
+  call i32 @madvise(i8* %lo_ptr, i64 %len, i32 4)
+  br label %done
+
+done:
+  ret void
+}
+
 ; Statistics: minor collections performed
 define i64 @__gc_stat_minor_collections() {
 entry:
@@ -2645,6 +3759,9 @@ entry:
 @__mem_limit_bytes = global i64 0     ; hard cap in bytes (0 = unlimited)
 @__mem_live_total = global i64 0      ; live bytes handed out by __sf_malloc
 @__mem_in_gc = global i64 0           ; re-entrancy guard: 1 while collecting
+@__mem_soft_bytes = global i64 0      ; soft limit in bytes (0 = 7/8 of the cap)
+@__mem_pressure_floor = global i64 0  ; live bytes after the last pressure GC
+@__mem_pressure_count = global i64 0  ; collections forced by memory pressure
 
 declare void @exit(i32)
 declare i8* @getenv(i8*)
@@ -2672,10 +3789,21 @@ declare i8* @calloc(i64, i64)
 ; a weak reference without -Wl,-U, so this is a plain declaration.
 declare i64 @malloc_size(i8*)
 
+; Returning freed memory to the OS. Blocks freed by the sweep go back to the
+; malloc zone, not the kernel, so madvise() cannot be aimed at them directly;
+; malloc_zone_pressure_relief() asks every zone to madvise(MADV_DONTNEED) its
+; own free pages. The nursery arena is ours, so it is released with madvise
+; itself (MADV_DONTNEED = 4 on both Darwin and Linux).
+declare i64 @malloc_zone_pressure_relief(i8*, i64)
+declare i32 @madvise(i8*, i64, i32)
+declare i32 @getpagesize()
+
 @.mem.msg_cap = private unnamed_addr constant [64 x i8] c"saffron: out of memory: allocation exceeded --max-memory limit\0A\00"
 @.mem.msg_fail = private unnamed_addr constant [43 x i8] c"saffron: out of memory: allocation failed\0A\00"
 @.mem.msg_badenv = private unnamed_addr constant [72 x i8] c"saffron: invalid SAFFRON_MAX_MEMORY value (use e.g. 512m, 2g, 1048576)\0A\00"
 @.mem.envname = private unnamed_addr constant [19 x i8] c"SAFFRON_MAX_MEMORY\00"
+@.mem.msg_badsoft = private unnamed_addr constant [73 x i8] c"saffron: invalid SAFFRON_SOFT_MEMORY value (use e.g. 448m, 2g, 1048576)\0A\00"
+@.mem.softname = private unnamed_addr constant [20 x i8] c"SAFFRON_SOFT_MEMORY\00"
 
 ; Report a cap breach and die. Allocates nothing.
 define private void @__mem_oom_cap() noinline {
@@ -2735,6 +3863,62 @@ zero:
   ret void
 }
 
+; The soft limit: SAFFRON_SOFT_MEMORY / GC.set_soft_memory() if set and below
+; the cap, otherwise 7/8 of the cap.
+define private i64 @__mem_soft_limit(i64 %limit) {
+entry:
+  %soft = load i64, i64* @__mem_soft_bytes
+  %unset = icmp eq i64 %soft, 0
+  %too_big = icmp uge i64 %soft, %limit
+  %derive = or i1 %unset, %too_big
+  %eighth = lshr i64 %limit, 3
+  %default = sub i64 %limit, %eighth
+  %r = select i1 %derive, i64 %default, i64 %soft
+  ret i64 %r
+}
+
+; A full collection forced by memory pressure, followed by everything that
+; makes the next one less likely:
+;   - the auto-collect threshold is pulled down to half the remaining headroom,
+;     so ordinary allocation collects more often while the cap is close;
+;   - the nursery (if enabled) is halved and its tail returned to the OS;
+;   - free pages held by malloc are returned to the OS, so the process's RSS —
+;     which is what a container's OOM killer looks at — follows the live heap
+;     down instead of staying at the spike's high-water mark.
+; The threshold only ever moves down here; the usual doubling in __gc_alloc
+; relaxes it again once collections stop finding garbage.
+define private void @__mem_pressure_collect(i64 %limit) noinline {
+entry:
+  store i64 1, i64* @__mem_in_gc
+  call i64 @__gc_collect()
+  store i64 0, i64* @__mem_in_gc
+  %live = load i64, i64* @__mem_live_total
+  store i64 %live, i64* @__mem_pressure_floor
+  %n = load i64, i64* @__mem_pressure_count
+  %n1 = add i64 %n, 1
+  store i64 %n1, i64* @__mem_pressure_count
+  %has_room = icmp ugt i64 %limit, %live
+  %room0 = sub i64 %limit, %live
+  %room = select i1 %has_room, i64 %room0, i64 0
+  %half_room = lshr i64 %room, 1
+  %gc_bytes = load i64, i64* @__gc_total_bytes
+  %target0 = add i64 %gc_bytes, %half_room
+  %tiny = icmp ult i64 %target0, 65536
+  %target = select i1 %tiny, i64 65536, i64 %target0
+  %thresh = load i64, i64* @__gc_threshold
+  %lower = icmp ugt i64 %thresh, %target
+  br i1 %lower, label %clamp, label %release
+
+clamp:
+  store i64 %target, i64* @__gc_threshold
+  br label %release
+
+release:
+  call void @__gc_nursery_shrink()
+  call i64 @malloc_zone_pressure_relief(i8* null, i64 0)
+  ret void
+}
+
 ; Reserve %size bytes against the cap. Dies on breach. No-op when unlimited.
 ;
 ; %may_collect controls whether one collection is attempted before declaring a
@@ -2763,7 +3947,40 @@ precheck:
   %live = load i64, i64* @__mem_live_total
   %after = add i64 %live, %size
   %over = icmp ugt i64 %after, %limit
-  br i1 %over, label %maybe_collect, label %ok
+  br i1 %over, label %maybe_collect, label %soft_check
+
+soft_check:
+  ; Under the cap but past the soft limit: collect early, before a spike turns
+  ; into a breach on a path that is not allowed to collect.
+  %soft = call i64 @__mem_soft_limit(i64 %limit)
+  %near = icmp ugt i64 %after, %soft
+  br i1 %near, label %pressure_gate, label %ok
+
+pressure_gate:
+  ; Same GC-enabled / may-collect gate as the hard path below.
+  %p_gc_on = load i64, i64* @__gc_enabled
+  %p_gc_is_on = icmp ne i64 %p_gc_on, 0
+  %p_want = icmp ne i64 %may_collect, 0
+  %p_can = and i1 %p_gc_is_on, %p_want
+  br i1 %p_can, label %pressure_step, label %ok
+
+pressure_step:
+  ; Rate limit: collect again only once live bytes have grown by 1/32 of the
+  ; cap since the last pressure collection, so a program sitting just past the
+  ; soft limit does not pay a full GC per allocation. The floor follows live
+  ; bytes down when the program frees on its own.
+  %floor0 = load i64, i64* @__mem_pressure_floor
+  %dropped = icmp ult i64 %live, %floor0
+  %floor = select i1 %dropped, i64 %live, i64 %floor0
+  store i64 %floor, i64* @__mem_pressure_floor
+  %step = lshr i64 %limit, 5
+  %next = add i64 %floor, %step
+  %due = icmp uge i64 %after, %next
+  br i1 %due, label %pressure, label %ok
+
+pressure:
+  call void @__mem_pressure_collect(i64 %limit)
+  br label %ok
 
 maybe_collect:
   ; Only collect if the GC is actually enabled. With it disabled — which is the
@@ -2779,9 +3996,7 @@ maybe_collect:
   br i1 %can, label %try_collect, label %breach
 
 try_collect:
-  store i64 1, i64* @__mem_in_gc
-  call i64 @__gc_collect()
-  store i64 0, i64* @__mem_in_gc
+  call void @__mem_pressure_collect(i64 %limit)
   %live2 = load i64, i64* @__mem_live_total
   %after2 = add i64 %live2, %size
   %still = icmp ugt i64 %after2, %limit
@@ -2964,6 +4179,36 @@ entry:
   ret i64 %v
 }
 
+; Install a soft limit. 0 restores the default of 7/8 of the cap; a value at or
+; above the cap is treated the same way.
+define void @__mem_set_soft_limit(i64 %bytes) {
+entry:
+  store i64 %bytes, i64* @__mem_soft_bytes
+  ret void
+}
+
+; The soft limit in effect, or 0 when there is no cap.
+define i64 @__mem_get_soft_limit() {
+entry:
+  %limit = load i64, i64* @__mem_limit_bytes
+  %unlimited = icmp eq i64 %limit, 0
+  br i1 %unlimited, label %none, label %derive
+
+derive:
+  %soft = call i64 @__mem_soft_limit(i64 %limit)
+  ret i64 %soft
+
+none:
+  ret i64 0
+}
+
+; Collections forced by approaching or hitting the cap.
+define i64 @__mem_pressure_collections() {
+entry:
+  %v = load i64, i64* @__mem_pressure_count
+  ret i64 %v
+}
+
 ; Live bytes as tracked by the wrapper. Reads 0 on unlimited runs, which do no
 ; accounting at all so that the fast path stays a load + branch.
 define i64 @__mem_live_bytes() {
@@ -3094,6 +4339,34 @@ report_bad:
   unreachable
 
 done:
+  ; SAFFRON_SOFT_MEMORY moves the point where pressure collections start. It is
+  ; read even without a cap so that GC.set_max_memory() later picks it up.
+  %soft_name = getelementptr [20 x i8], [20 x i8]* @.mem.softname, i64 0, i64 0
+  %soft_val = call i8* @getenv(i8* %soft_name)
+  %soft_null = icmp eq i8* %soft_val, null
+  br i1 %soft_null, label %finish, label %soft_check_empty
+
+soft_check_empty:
+  %s0 = load i8, i8* %soft_val
+  %soft_empty = icmp eq i8 %s0, 0
+  br i1 %soft_empty, label %finish, label %soft_parse
+
+soft_parse:
+  %sn = call i64 @__mem_parse_size(i8* %soft_val)
+  %soft_bad = icmp eq i64 %sn, -1
+  br i1 %soft_bad, label %report_bad_soft, label %soft_install
+
+soft_install:
+  store i64 %sn, i64* @__mem_soft_bytes
+  br label %finish
+
+report_bad_soft:
+  %smsg = getelementptr [73 x i8], [73 x i8]* @.mem.msg_badsoft, i64 0, i64 0
+  call i64 @write(i32 2, i8* %smsg, i64 72)
+  call void @exit(i32 1)
+  unreachable
+
+finish:
   ret void
 }
 
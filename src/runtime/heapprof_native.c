@@ -0,0 +1,441 @@
+/*
+ * Saffron Runtime: Allocation-Site Heap Profiler
+ * ==============================================
+ *
+ * Opt-in sampling heap profiler for native builds. Off unless the process is
+ * started with SAFFRON_HEAP_PROFILE set:
+ *
+ *   SAFFRON_HEAP_PROFILE=/tmp/svc ./svc          # write /tmp/svc.*.folded
+ *   SAFFRON_HEAP_PROFILE_RATE=64k                # mean bytes between samples
+ *
+ * ── The fast path lives in gc.ll ───────────────────────────────────────────
+ * @__gc_alloc and @__gc_alloc_safe subtract each allocation's size from
+ * @__gc_prof_countdown and call __heapprof_sample() only when it goes negative.
+ * With the profiler off the countdown starts at INT64_MAX and never gets there,
+ * so a disabled profiler costs one never-taken branch next to the counters the
+ * allocator already bumps. Everything in this file runs only on a sample.
+ *
+ * ── Call sites without codegen ─────────────────────────────────────────────
+ * A sampled allocation records its full native call stack with backtrace(3)
+ * and interns it as a "site". Codegen does not pass a site id: at the default
+ * 512 KiB rate only one allocation in thousands is sampled, so walking the
+ * stack then is cheaper than threading an id through every allocating call,
+ * and it yields whole stacks (a flame graph) rather than one frame. Frames are
+ * symbolized with dladdr(3) only when a profile is written.
+ *
+ * ── What is reported ───────────────────────────────────────────────────────
+ * Each sample is weighted by the bytes allocated since the previous sample, so
+ * per-site totals are unbiased estimates of real bytes. Sampled objects get
+ * bit 1 of their GC header info word set; the sweep calls __heapprof_free()
+ * for those, which is how a site's in-use bytes come back down. Three folded-
+ * stack files (flamegraph.pl / speedscope / inferno format) are written:
+ *
+ *   <prefix>.alloc.folded      bytes allocated, ever
+ *   <prefix>.inuse.folded      bytes still live (retained) at dump time
+ *   <prefix>.survived.folded   bytes that lived through at least one collection
+ *
+ * The collector has no active young generation (see the nursery section of
+ * gc.ll), so "survived" is measured against full collections: an object
+ * survives if @__gc_collections advanced between its allocation and its sweep.
+ *
+ * Profiles are written at exit, and on SIGUSR2 for long-running services. The
+ * signal handler only zeroes the countdown and raises a flag; the dump itself
+ * happens inside the next allocation, on the allocating thread, because stdio
+ * and dladdr are not async-signal-safe.
+ */
+
+/* Dl_info / dladdr are GNU extensions in glibc's <dlfcn.h>. */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+
+/* Owned by gc.ll. */
+extern int64_t __gc_prof_countdown;
+extern int64_t __gc_collections;
+
+#define HP_MAX_DEPTH 64
+#define HP_DEFAULT_RATE (512 * 1024)
+
+/* ===== State ===== */
+
+typedef struct {
+    void *pcs[HP_MAX_DEPTH];
+    int depth;
+    uint64_t hash;
+    int64_t alloc_bytes;
+    int64_t inuse_bytes;
+    int64_t survived_freed;     /* survived bytes of samples already swept */
+} hp_site;
+
+typedef struct {
+    int64_t ptr;                /* 0 = empty slot */
+    int64_t site;
+    int64_t weight;
+    int64_t born;               /* @__gc_collections at allocation */
+} hp_live;
+
+static char *hp_prefix = NULL;
+static int64_t hp_rate = HP_DEFAULT_RATE;
+static int64_t hp_interval = 0;        /* countdown the last sample armed */
+static uint64_t hp_rng = 0x9E3779B97F4A7C15ull;
+static volatile sig_atomic_t hp_dump_pending = 0;
+static int hp_in_sample = 0;
+
+static hp_site *hp_sites = NULL;
+static int64_t hp_site_count = 0, hp_site_cap = 0;
+static int64_t *hp_site_index = NULL;   /* open-addressed: site idx + 1, 0 = empty */
+static int64_t hp_site_index_cap = 0;
+
+static hp_live *hp_live_tab = NULL;     /* open-addressed on ptr, backward-shift delete */
+static int64_t hp_live_count = 0, hp_live_cap = 0;
+
+/* ===== Helpers ===== */
+
+static uint64_t hp_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+/*
+ * Next countdown: uniformly jittered in [rate/2, 3*rate/2). A fixed interval
+ * would alias with a loop that allocates the same sizes in the same order and
+ * sample the same site every time.
+ */
+static int64_t hp_next_interval(void) {
+    hp_rng ^= hp_rng << 13;
+    hp_rng ^= hp_rng >> 7;
+    hp_rng ^= hp_rng << 17;
+    int64_t jitter = (int64_t)(hp_rng % (uint64_t)hp_rate);
+    return hp_rate / 2 + jitter + 1;
+}
+
+static void *hp_grow(void *p, int64_t n, size_t elem) {
+    void *q = realloc(p, (size_t)n * elem);
+    if (!q) {
+        /* Profiling is best-effort: disable rather than disturb the program. */
+        __gc_prof_countdown = INT64_MAX;
+        hp_prefix = NULL;
+    }
+    return q;
+}
+
+/* ===== Sites ===== */
+
+static void hp_site_index_insert(int64_t idx) {
+    int64_t mask = hp_site_index_cap - 1;
+    int64_t i = (int64_t)(hp_sites[idx].hash & (uint64_t)mask);
+    while (hp_site_index[i] != 0) i = (i + 1) & mask;
+    hp_site_index[i] = idx + 1;
+}
+
+static int64_t hp_intern_site(void **pcs, int depth) {
+    uint64_t h = (uint64_t)depth;
+    for (int i = 0; i < depth; i++) h = hp_mix(h ^ (uint64_t)(uintptr_t)pcs[i]);
+
+    if (hp_site_index_cap > 0) {
+        int64_t mask = hp_site_index_cap - 1;
+        int64_t i = (int64_t)(h & (uint64_t)mask);
+        while (hp_site_index[i] != 0) {
+            hp_site *s = &hp_sites[hp_site_index[i] - 1];
+            if (s->hash == h && s->depth == depth &&
+                memcmp(s->pcs, pcs, (size_t)depth * sizeof(void *)) == 0) {
+                return hp_site_index[i] - 1;
+            }
+            i = (i + 1) & mask;
+        }
+    }
+
+    if (hp_site_count >= hp_site_cap) {
+        int64_t cap = hp_site_cap ? hp_site_cap * 2 : 256;
+        hp_site *ns = hp_grow(hp_sites, cap, sizeof(hp_site));
+        if (!ns) return -1;
+        hp_sites = ns;
+        hp_site_cap = cap;
+    }
+    if ((hp_site_count + 1) * 2 > hp_site_index_cap) {
+        int64_t cap = hp_site_index_cap ? hp_site_index_cap * 2 : 512;
+        int64_t *ni = calloc((size_t)cap, sizeof(int64_t));
+        if (!ni) return -1;
+        free(hp_site_index);
+        hp_site_index = ni;
+        hp_site_index_cap = cap;
+        for (int64_t k = 0; k < hp_site_count; k++) hp_site_index_insert(k);
+    }
+
+    int64_t idx = hp_site_count++;
+    hp_site *s = &hp_sites[idx];
+    memset(s, 0, sizeof(*s));
+    memcpy(s->pcs, pcs, (size_t)depth * sizeof(void *));
+    s->depth = depth;
+    s->hash = h;
+    hp_site_index_insert(idx);
+    return idx;
+}
+
+/* ===== Live samples ===== */
+
+static int64_t hp_live_home(int64_t ptr, int64_t mask) {
+    return (int64_t)(hp_mix((uint64_t)ptr) & (uint64_t)mask);
+}
+
+static void hp_live_put(hp_live rec) {
+    int64_t mask = hp_live_cap - 1;
+    int64_t i = hp_live_home(rec.ptr, mask);
+    while (hp_live_tab[i].ptr != 0) i = (i + 1) & mask;
+    hp_live_tab[i] = rec;
+}
+
+static int hp_live_reserve(void) {
+    if ((hp_live_count + 1) * 2 <= hp_live_cap) return 1;
+    int64_t old_cap = hp_live_cap;
+    hp_live *old = hp_live_tab;
+    int64_t cap = old_cap ? old_cap * 2 : 1024;
+    hp_live *nt = calloc((size_t)cap, sizeof(hp_live));
+    if (!nt) return 0;
+    hp_live_tab = nt;
+    hp_live_cap = cap;
+    for (int64_t i = 0; i < old_cap; i++) {
+        if (old[i].ptr != 0) hp_live_put(old[i]);
+    }
+    free(old);
+    return 1;
+}
+
+/* Remove and return the record for ptr; .ptr == 0 if it was not sampled. */
+static hp_live hp_live_take(int64_t ptr) {
+    hp_live none = {0, 0, 0, 0};
+    if (hp_live_cap == 0) return none;
+    int64_t mask = hp_live_cap - 1;
+    int64_t i = hp_live_home(ptr, mask);
+    while (hp_live_tab[i].ptr != ptr) {
+        if (hp_live_tab[i].ptr == 0) return none;
+        i = (i + 1) & mask;
+    }
+    hp_live rec = hp_live_tab[i];
+    /* Backward-shift delete keeps probe chains intact without tombstones. */
+    int64_t hole = i;
+    int64_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (hp_live_tab[j].ptr == 0) break;
+        int64_t home = hp_live_home(hp_live_tab[j].ptr, mask);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            hp_live_tab[hole] = hp_live_tab[j];
+            hole = j;
+        }
+    }
+    hp_live_tab[hole].ptr = 0;
+    hp_live_count--;
+    return rec;
+}
+
+/* ===== Dump ===== */
+
+/*
+ * Allocator frames are noise at the leaf end of every stack (every sample
+ * passes through __gc_alloc and this file); drop them so each stack ends at
+ * the runtime helper or Saffron function that asked for memory.
+ */
+static int hp_is_allocator_frame(const char *name) {
+    return name && (strncmp(name, "__gc_", 5) == 0 ||
+                    strncmp(name, "__heapprof_", 11) == 0 ||
+                    strncmp(name, "__sf_malloc", 11) == 0);
+}
+
+static void hp_write_frame(FILE *f, void *pc) {
+    Dl_info info;
+    if (dladdr(pc, &info) && info.dli_sname) {
+        /* ';' and ' ' are the folded format's separators. */
+        for (const char *c = info.dli_sname; *c; c++) {
+            fputc((*c == ';' || *c == ' ') ? '_' : *c, f);
+        }
+    } else {
+        fprintf(f, "0x%llx", (unsigned long long)(uintptr_t)pc);
+    }
+}
+
+static void hp_write_stack(FILE *f, hp_site *s) {
+    /* backtrace() is leaf-first; folded stacks are root-first. */
+    int leaf = 0;
+    while (leaf < s->depth) {
+        Dl_info info;
+        if (!dladdr(s->pcs[leaf], &info) || !hp_is_allocator_frame(info.dli_sname)) break;
+        leaf++;
+    }
+    if (leaf == s->depth) leaf = 0;
+    int first = 1;
+    for (int i = s->depth - 1; i >= leaf; i--) {
+        if (!first) fputc(';', f);
+        hp_write_frame(f, s->pcs[i]);
+        first = 0;
+    }
+}
+
+static void hp_write_profile(const char *kind, const int64_t *values) {
+    size_t len = strlen(hp_prefix) + strlen(kind) + 16;
+    char *path = malloc(len);
+    if (!path) return;
+    snprintf(path, len, "%s.%s.folded", hp_prefix, kind);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "saffron: heap profile: cannot write %s\n", path);
+        free(path);
+        return;
+    }
+    for (int64_t i = 0; i < hp_site_count; i++) {
+        if (values[i] <= 0) continue;
+        hp_write_stack(f, &hp_sites[i]);
+        fprintf(f, " %lld\n", (long long)values[i]);
+    }
+    fclose(f);
+    free(path);
+}
+
+static void hp_dump(void) {
+    if (!hp_prefix || hp_site_count == 0) return;
+    int64_t *vals = calloc((size_t)hp_site_count, sizeof(int64_t));
+    if (!vals) return;
+
+    for (int64_t i = 0; i < hp_site_count; i++) vals[i] = hp_sites[i].alloc_bytes;
+    hp_write_profile("alloc", vals);
+
+    for (int64_t i = 0; i < hp_site_count; i++) vals[i] = hp_sites[i].inuse_bytes;
+    hp_write_profile("inuse", vals);
+
+    /* Survived = already-swept survivors + live samples born before the
+       latest collection. */
+    for (int64_t i = 0; i < hp_site_count; i++) vals[i] = hp_sites[i].survived_freed;
+    for (int64_t i = 0; i < hp_live_cap; i++) {
+        hp_live *r = &hp_live_tab[i];
+        if (r->ptr != 0 && __gc_collections > r->born) vals[r->site] += r->weight;
+    }
+    hp_write_profile("survived", vals);
+
+    free(vals);
+}
+
+/* ===== Entry points from gc.ll ===== */
+
+/*
+ * __heapprof_sample — Called by the allocator once @__gc_prof_countdown has
+ * gone negative. `user_ptr` is the new object (header at user_ptr - 24).
+ */
+void __heapprof_sample(int64_t user_ptr, int64_t size) {
+    (void)size;
+    if (!hp_prefix || hp_in_sample) {
+        if (!hp_prefix) __gc_prof_countdown = INT64_MAX;
+        return;
+    }
+    hp_in_sample = 1;
+
+    /* Bytes since the previous sample, overshoot included: the sum of all
+       weights is exactly the bytes allocated while profiling. */
+    int64_t weight = hp_interval - __gc_prof_countdown;
+    hp_interval = hp_next_interval();
+    __gc_prof_countdown = hp_interval;
+
+    if (hp_dump_pending) {
+        hp_dump_pending = 0;
+        hp_dump();
+    }
+
+    void *pcs[HP_MAX_DEPTH + 1];
+    int n = backtrace(pcs, HP_MAX_DEPTH + 1);
+    /* Frame 0 is this function. */
+    int64_t site = n > 1 ? hp_intern_site(pcs + 1, n - 1) : -1;
+    if (site >= 0 && hp_live_reserve()) {
+        hp_sites[site].alloc_bytes += weight;
+        hp_sites[site].inuse_bytes += weight;
+        hp_live rec = { user_ptr, site, weight, __gc_collections };
+        hp_live_put(rec);
+        hp_live_count++;
+        int64_t *info = (int64_t *)(intptr_t)(user_ptr - 16);
+        *info |= 2;
+    }
+    hp_in_sample = 0;
+}
+
+/*
+ * __heapprof_free — Called by the sweep for an object whose header carries the
+ * sampled bit, just before it is freed.
+ */
+void __heapprof_free(int64_t user_ptr, int64_t size) {
+    (void)size;
+    hp_live rec = hp_live_take(user_ptr);
+    if (rec.ptr == 0) return;
+    hp_site *s = &hp_sites[rec.site];
+    s->inuse_bytes -= rec.weight;
+    /* The sweep runs before @__gc_collections is bumped, so an object swept
+       by the first collection after its birth still reads born == current. */
+    if (__gc_collections > rec.born) s->survived_freed += rec.weight;
+}
+
+/* ===== Setup ===== */
+
+static void hp_on_signal(int signum) {
+    (void)signum;
+    hp_dump_pending = 1;
+    /* Force the next allocation onto the sample path so the dump is prompt. */
+    __gc_prof_countdown = 0;
+}
+
+static void hp_atexit(void) {
+    hp_dump();
+}
+
+/* Same size syntax as SAFFRON_MAX_MEMORY: digits with optional k/m/g. */
+static int64_t hp_parse_size(const char *s) {
+    if (!s || !*s) return -1;
+    int64_t v = 0;
+    const char *c = s;
+    for (; *c >= '0' && *c <= '9'; c++) v = v * 10 + (*c - '0');
+    if (c == s) return -1;
+    switch (*c) {
+    case 'k': case 'K': v *= 1024; c++; break;
+    case 'm': case 'M': v *= 1024 * 1024; c++; break;
+    case 'g': case 'G': v *= 1024 * 1024 * 1024; c++; break;
+    default: break;
+    }
+    return *c == '\0' ? v : -1;
+}
+
+__attribute__((constructor)) static void hp_init(void) {
+    const char *prefix = getenv("SAFFRON_HEAP_PROFILE");
+    if (!prefix || !*prefix) return;
+
+    const char *rate_s = getenv("SAFFRON_HEAP_PROFILE_RATE");
+    if (rate_s) {
+        int64_t r = hp_parse_size(rate_s);
+        if (r <= 0) {
+            fprintf(stderr, "saffron: invalid SAFFRON_HEAP_PROFILE_RATE: %s\n", rate_s);
+            exit(1);
+        }
+        hp_rate = r;
+    }
+
+    hp_prefix = strdup(prefix);
+    if (!hp_prefix) return;
+    hp_rng ^= (uint64_t)(uintptr_t)&prefix;
+    hp_interval = hp_next_interval();
+    __gc_prof_countdown = hp_interval;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = hp_on_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &sa, NULL);
+    atexit(hp_atexit);
+}
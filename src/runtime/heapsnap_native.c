@@ -0,0 +1,346 @@
+/*
+ * Saffron Runtime: Heap Snapshots
+ * ===============================
+ *
+ * Writes the whole GC heap — every object, its type, size and outgoing
+ * references, plus the root set — to a compact binary file for offline
+ * analysis by tools/heapsnap (dominator tree, retained sizes, top retainers).
+ * Driven from GC.snapshot(path) in src/lib/gc.sf, which collects first so the
+ * file holds only live objects.
+ *
+ * ── Why four calls instead of one ──────────────────────────────────────────
+ * Class names exist only in codegen's __reflect_class_name, which switches on
+ * the program's own class table and takes a *value*, not a tag. So the .sf side
+ * drives it: sf_heap_snapshot_scan() finds one instance of every class tag on
+ * the heap, gc.sf asks Reflect for each one's name and hands it back through
+ * sf_heap_snapshot_class_name(), and only then does sf_heap_snapshot_write()
+ * produce the file. Nothing here calls into Saffron.
+ *
+ * ── Layout knowledge ───────────────────────────────────────────────────────
+ * The walk mirrors __gc_mark_drain in gc.ll: the 24-byte header { next, info,
+ * magic } sits before every user pointer, info is mark | tag << 8 | size << 16,
+ * and the per-tag edge rules are the same ones the mark phase traces. Tag-0
+ * objects (raw buffers, weak cells, ephemeron tables) have no edges — a weak
+ * reference is not a retaining path. If the mark phase learns a new shape,
+ * snapshot_edges() must learn it too.
+ *
+ * ── File format (all integers unsigned LEB128 varints) ─────────────────────
+ *
+ *   "SFHEAP01"                                   8-byte magic
+ *   class_count, { tag, name_len, name bytes }   name_len 0 = unknown
+ *   object_count, { tag, size, edge_count, { target index } }
+ *   root_count, { object index }
+ *
+ * Objects are numbered 0..object_count-1 in file order; edges and roots refer
+ * to those indices, never to addresses. `size` is the payload size; the 24-byte
+ * header is not included.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Owned by gc.ll. */
+extern int64_t __gc_head;
+extern int64_t __gc_shadow_stack;
+extern int64_t __gc_stacks;
+extern int64_t __gc_temp_roots;
+extern int64_t __gc_temp_count;
+extern int64_t __gc_nursery_start;
+extern int64_t __gc_nursery_ptr;
+extern int64_t __gc_nursery_inited;
+
+#define HS_HEADER 24
+#define HS_TAG_PTR_BITS 0x7FF8ull
+#define HS_PAYLOAD_MASK 0x0000FFFFFFFFFFFFull
+
+/* ===== Object index ===== */
+
+typedef struct {
+    int64_t *ptrs;          /* user pointers, file order */
+    int64_t count, cap;
+    int64_t *slots;         /* open-addressed: index + 1, 0 = empty */
+    int64_t slot_cap;
+} hs_index;
+
+static uint64_t hs_hash(int64_t p) {
+    uint64_t x = (uint64_t)p;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    return x;
+}
+
+static int hs_add(hs_index *ix, int64_t p) {
+    if (ix->count >= ix->cap) {
+        int64_t cap = ix->cap ? ix->cap * 2 : 4096;
+        int64_t *np = realloc(ix->ptrs, (size_t)cap * sizeof(int64_t));
+        if (!np) return 0;
+        ix->ptrs = np;
+        ix->cap = cap;
+    }
+    ix->ptrs[ix->count++] = p;
+    return 1;
+}
+
+static int hs_build_slots(hs_index *ix) {
+    int64_t cap = 1024;
+    while (cap < ix->count * 2) cap *= 2;
+    ix->slots = calloc((size_t)cap, sizeof(int64_t));
+    if (!ix->slots) return 0;
+    ix->slot_cap = cap;
+    int64_t mask = cap - 1;
+    for (int64_t i = 0; i < ix->count; i++) {
+        int64_t s = (int64_t)(hs_hash(ix->ptrs[i]) & (uint64_t)mask);
+        while (ix->slots[s] != 0) s = (s + 1) & mask;
+        ix->slots[s] = i + 1;
+    }
+    return 1;
+}
+
+/* Index of the heap object a slot value refers to, or -1. Accepts tagged and
+   untagged pointers, like __gc_mark_object. */
+static int64_t hs_lookup(hs_index *ix, int64_t val) {
+    uint64_t v = (uint64_t)val;
+    if ((v >> 48) == HS_TAG_PTR_BITS) v &= HS_PAYLOAD_MASK;
+    if (v == 0 || (v & 7) != 0 || (v >> 48) != 0) return -1;
+    int64_t mask = ix->slot_cap - 1;
+    int64_t s = (int64_t)(hs_hash((int64_t)v) & (uint64_t)mask);
+    while (ix->slots[s] != 0) {
+        int64_t i = ix->slots[s] - 1;
+        if (ix->ptrs[i] == (int64_t)v) return i;
+        s = (s + 1) & mask;
+    }
+    return -1;
+}
+
+static int64_t hs_info(int64_t user) { return *(int64_t *)(intptr_t)(user - 16); }
+static int64_t hs_tag(int64_t user) { return (hs_info(user) >> 8) & 0xFF; }
+static int64_t hs_size(int64_t user) { return (int64_t)((uint64_t)hs_info(user) >> 16); }
+static int64_t hs_word(int64_t addr) { return *(int64_t *)(intptr_t)addr; }
+
+static int hs_collect(hs_index *ix) {
+    for (int64_t h = __gc_head; h != 0; h = hs_word(h)) {
+        if (!hs_add(ix, h + HS_HEADER)) return 0;
+    }
+    /* The nursery is normally off (see gc.ll); walk it when someone turned
+       it back on. Objects are packed at align8(24 + size). */
+    if (__gc_nursery_inited) {
+        int64_t pos = __gc_nursery_start;
+        while (pos < __gc_nursery_ptr) {
+            int64_t user = pos + HS_HEADER;
+            int64_t step = (HS_HEADER + hs_size(user) + 7) & ~(int64_t)7;
+            if (!hs_add(ix, user)) return 0;
+            pos += step;
+        }
+    }
+    return hs_build_slots(ix);
+}
+
+static void hs_free_index(hs_index *ix) {
+    free(ix->ptrs);
+    free(ix->slots);
+    memset(ix, 0, sizeof(*ix));
+}
+
+/* ===== Class table (filled by scan + class_name) ===== */
+
+typedef struct {
+    int64_t tag;
+    int64_t sample;
+    char *name;
+} hs_class;
+
+static hs_class hs_classes[256];     /* tags are 8 bits wide */
+static int64_t hs_class_count = 0;
+
+static void hs_clear_classes(void) {
+    for (int64_t i = 0; i < hs_class_count; i++) free(hs_classes[i].name);
+    memset(hs_classes, 0, sizeof(hs_classes));
+    hs_class_count = 0;
+}
+
+/* ===== Writer ===== */
+
+static void hs_varint(FILE *f, uint64_t v) {
+    do {
+        uint8_t b = v & 0x7F;
+        v >>= 7;
+        if (v) b |= 0x80;
+        fputc(b, f);
+    } while (v);
+}
+
+/* Append edge targets of `user` to *edges (reset by caller). Mirrors
+   __gc_mark_drain tag by tag. */
+static int hs_edges(hs_index *ix, int64_t user, int64_t **edges, int64_t *n, int64_t *cap) {
+#define HS_EDGE(val) do {                                                   \
+        int64_t t_ = hs_lookup(ix, (val));                                  \
+        if (t_ >= 0) {                                                      \
+            if (*n >= *cap) {                                               \
+                int64_t c_ = *cap ? *cap * 2 : 64;                          \
+                int64_t *e_ = realloc(*edges, (size_t)c_ * sizeof(int64_t)); \
+                if (!e_) return 0;                                          \
+                *edges = e_;                                                \
+                *cap = c_;                                                  \
+            }                                                               \
+            (*edges)[(*n)++] = t_;                                          \
+        }                                                                   \
+    } while (0)
+
+    int64_t tag = hs_tag(user);
+    int64_t size = hs_size(user);
+    switch (tag) {
+    case 2: {   /* list { count, cap, data } */
+        int64_t count = hs_word(user), data = hs_word(user + 16);
+        HS_EDGE(data);
+        if (data) for (int64_t i = 0; i < count; i++) HS_EDGE(hs_word(data + i * 8));
+        break;
+    }
+    case 3: {   /* map { count, cap, keys, vals } */
+        int64_t count = hs_word(user);
+        int64_t keys = hs_word(user + 16), vals = hs_word(user + 24);
+        HS_EDGE(keys);
+        HS_EDGE(vals);
+        for (int64_t i = 0; i < count; i++) {
+            if (keys) HS_EDGE(hs_word(keys + i * 8));
+            if (vals) HS_EDGE(hs_word(vals + i * 8));
+        }
+        break;
+    }
+    case 4:     /* closure { fn, env } */
+        HS_EDGE(hs_word(user + 8));
+        break;
+    case 6:     /* stringbuilder { len, cap, buf } */
+        HS_EDGE(hs_word(user + 16));
+        break;
+    case 0: case 1: case 7: case 8:
+        /* opaque, string, and the inner arrays their parents already scan */
+        break;
+    default:    /* 5, 9 and every class tag >= 10: all slots */
+        for (int64_t i = 0; i < size / 8; i++) HS_EDGE(hs_word(user + i * 8));
+        break;
+    }
+    return 1;
+#undef HS_EDGE
+}
+
+/* ===== Exports (declared in src/lib/gc.sf) ===== */
+
+/*
+ * sf_heap_snapshot_scan — Find one live instance of each class tag (>= 10).
+ * Returns the number found; sf_heap_snapshot_class_sample(i) returns the i-th.
+ */
+int64_t sf_heap_snapshot_scan(void) {
+    hs_clear_classes();
+    int seen[256] = {0};
+    for (int64_t h = __gc_head; h != 0; h = hs_word(h)) {
+        int64_t user = h + HS_HEADER;
+        int64_t tag = hs_tag(user);
+        if (tag >= 10 && !seen[tag]) {
+            seen[tag] = 1;
+            hs_classes[hs_class_count].tag = tag;
+            hs_classes[hs_class_count].sample = user;
+            hs_class_count++;
+        }
+    }
+    return hs_class_count;
+}
+
+int64_t sf_heap_snapshot_class_sample(int64_t i) {
+    if (i < 0 || i >= hs_class_count) return 0;
+    return hs_classes[i].sample;
+}
+
+/* Record the name Reflect gave class i. "Unknown" (an enum payload, which
+   shares the tag space) is stored as no name. */
+void sf_heap_snapshot_class_name(int64_t i, const char *name) {
+    if (i < 0 || i >= hs_class_count || !name) return;
+    if (strcmp(name, "Unknown") == 0) return;
+    free(hs_classes[i].name);
+    hs_classes[i].name = strdup(name);
+}
+
+/*
+ * sf_heap_snapshot_write — Write the snapshot to `path`.
+ * Returns the number of objects written, or -1 if the file could not be
+ * written or memory for the index ran out.
+ */
+int64_t sf_heap_snapshot_write(const char *path) {
+    hs_index ix;
+    memset(&ix, 0, sizeof(ix));
+    if (!hs_collect(&ix)) {
+        hs_free_index(&ix);
+        return -1;
+    }
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        hs_free_index(&ix);
+        return -1;
+    }
+
+    fwrite("SFHEAP01", 1, 8, f);
+
+    hs_varint(f, (uint64_t)hs_class_count);
+    for (int64_t i = 0; i < hs_class_count; i++) {
+        const char *name = hs_classes[i].name;
+        size_t len = name ? strlen(name) : 0;
+        hs_varint(f, (uint64_t)hs_classes[i].tag);
+        hs_varint(f, (uint64_t)len);
+        if (len) fwrite(name, 1, len, f);
+    }
+
+    int ok = 1;
+    int64_t *edges = NULL, n_edges = 0, edges_cap = 0;
+    hs_varint(f, (uint64_t)ix.count);
+    for (int64_t i = 0; i < ix.count && ok; i++) {
+        int64_t user = ix.ptrs[i];
+        n_edges = 0;
+        ok = hs_edges(&ix, user, &edges, &n_edges, &edges_cap);
+        hs_varint(f, (uint64_t)hs_tag(user));
+        hs_varint(f, (uint64_t)hs_size(user));
+        hs_varint(f, (uint64_t)n_edges);
+        for (int64_t e = 0; e < n_edges; e++) hs_varint(f, (uint64_t)edges[e]);
+    }
+
+    /* Roots: shadow-stack entries are slot ADDRESSES, temp roots are values
+       (see __gc_mark). Duplicates are harmless to the analyzer. */
+    /* Every thread's stack is on __gc_stacks; a thread parked off the GRL has
+       its temp roots saved in its struct (gc.ll, "Per-thread Root Switching"). */
+    int64_t n_roots = 0;
+    int64_t *roots = NULL;
+    int64_t total = 1;
+    for (int64_t ss = __gc_stacks; ss; ss = hs_word(ss + 24)) {
+        total += hs_word(ss);
+        total += ss == __gc_shadow_stack ? __gc_temp_count : hs_word(ss + 40);
+    }
+    roots = malloc((size_t)total * sizeof(int64_t));
+    if (!roots) ok = 0;
+    for (int64_t ss = __gc_stacks; ok && ss; ss = hs_word(ss + 24)) {
+        int64_t ss_count = hs_word(ss), ss_data = hs_word(ss + 16);
+        for (int64_t i = 0; i < ss_count; i++) {
+            int64_t slot = hs_word(ss_data + i * 8);
+            if (slot == 0) continue;
+            int64_t t = hs_lookup(&ix, hs_word(slot));
+            if (t >= 0) roots[n_roots++] = t;
+        }
+        int64_t running = ss == __gc_shadow_stack;
+        int64_t t_count = running ? __gc_temp_count : hs_word(ss + 40);
+        int64_t t_data = running ? __gc_temp_roots : hs_word(ss + 32);
+        for (int64_t i = 0; i < t_count; i++) {
+            int64_t t = hs_lookup(&ix, hs_word(t_data + i * 8));
+            if (t >= 0) roots[n_roots++] = t;
+        }
+    }
+    hs_varint(f, (uint64_t)n_roots);
+    for (int64_t i = 0; i < n_roots; i++) hs_varint(f, (uint64_t)roots[i]);
+
+    free(roots);
+    free(edges);
+    if (fclose(f) != 0) ok = 0;
+    int64_t written = ix.count;
+    hs_free_index(&ix);
+    hs_clear_classes();
+    return ok ? written : -1;
+}
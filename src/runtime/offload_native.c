@@ -0,0 +1,368 @@
+/*
+ * Saffron Runtime: Blocking-work Offload Pool
+ * ===========================================
+ *
+ * Regular files are always "ready" to epoll and poll(), so a disk read issued
+ * from a task runs to completion on the scheduler thread and every other task
+ * waits behind it — one slow read of a large file stalls every connection. This
+ * pool runs those reads on a few helper threads instead. A task submits the
+ * operation, suspends with yield reason 8 on the op id, and the scheduler
+ * re-queues it once a helper has finished.
+ *
+ * Only tasks offload. The scheduler brackets each resume with
+ * sf_offload_in_task(1)/(0), and outside that bracket every submit returns -1,
+ * so a caller on the main program path (a build script, the compiler reading
+ * its sources) keeps the plain blocking read with no thread hop.
+ *
+ * ── Operations ─────────────────────────────────────────────────────────────
+ * A submit returns an op id (>= 0). The task then either suspends with
+ * __suspend(8, op) — the scheduler calls sf_offload_park(op, handle) — or just
+ * calls sf_offload_result(op), which blocks until the op is done (that is what
+ * happens when a sync caller drives the coroutine itself). sf_offload_finish(op)
+ * hands over any buffer the op produced and frees the op.
+ *
+ * ── Waking the scheduler ───────────────────────────────────────────────────
+ * A helper that completes a PARKED op appends its handle to a ready list and
+ * writes a byte to a nonblocking pipe. The scheduler keeps the pipe's read end
+ * armed in the reactor while anything is parked, so one reactor wait covers
+ * sockets, timers and offloaded reads; sf_offload_drain() empties the pipe and
+ * the ready list. An op nobody parked on signals only its condvar.
+ *
+ * Helpers never touch the managed heap and never take the GRL. They start on
+ * first use; SAFFRON_BLOCKING_THREADS sets how many (default 4, at most 64).
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define OF_FREE    0
+#define OF_QUEUED  1
+#define OF_RUNNING 2
+#define OF_DONE    3
+
+#define OF_READ_FILE 1   /* whole file into a fresh NUL-terminated buffer */
+#define OF_PREAD     2   /* pread into the caller's buffer */
+
+#define OF_MAX_THREADS 64
+
+typedef struct {
+    int state;
+    int kind;
+    char *path;          /* OF_READ_FILE: owned copy */
+    int fd;              /* OF_PREAD */
+    char *buf;           /* OF_PREAD: caller's; OF_READ_FILE: result, malloc'd */
+    int64_t len;
+    int64_t off;
+    int64_t result;      /* bytes read, or -1 */
+    int parked;
+    int reported;        /* token is in the ready list, or was handed out */
+    int64_t token;       /* the parked task's handle */
+    int64_t next;        /* free list / queue link */
+} of_op;
+
+static pthread_mutex_t of_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t of_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t of_done = PTHREAD_COND_INITIALIZER;
+
+static of_op *of_ops = NULL;
+static int64_t of_nops = 0, of_cap = 0;
+static int64_t of_free_head = -1;
+static int64_t of_q_head = -1, of_q_tail = -1;
+
+static int of_started = 0;           /* 1 running, -1 could not start */
+static int of_pipe[2] = {-1, -1};
+static int of_task_depth = 0;        /* scheduler thread only */
+
+/* Handles of parked ops that completed; drained into of_snap for reading. The
+ * two buffers trade places on every drain, so each keeps its own capacity.
+ * of_ready_lost says a completion could not be recorded (out of memory); the
+ * next drain finds it by rescanning for parked, done, unreported ops. */
+static int64_t *of_ready = NULL, *of_snap = NULL;
+static int64_t of_ready_count = 0, of_ready_cap = 0;
+static int64_t of_snap_count = 0, of_snap_cap = 0;
+static int of_ready_lost = 0;
+
+static void of_set_nonblock(int fd) {
+    int fl = fcntl(fd, F_GETFL, 0);
+    if (fl >= 0) fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+/* Append `v` to a handle list, growing it. Returns 0 if memory ran out. */
+static int of_push(int64_t **list, int64_t *count, int64_t *cap, int64_t v) {
+    if (*count == *cap) {
+        int64_t n = *cap ? *cap * 2 : 64;
+        int64_t *grown = realloc(*list, (size_t)n * sizeof(int64_t));
+        if (!grown) return 0;
+        *list = grown;
+        *cap = n;
+    }
+    (*list)[(*count)++] = v;
+    return 1;
+}
+
+static int64_t of_do_read_file(of_op *op, char **out) {
+    *out = NULL;
+    int fd = open(op->path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return -1; }
+    int64_t size = st.st_size > 0 ? (int64_t)st.st_size : 0;
+    char *buf = malloc((size_t)size + 1);
+    if (!buf) { close(fd); return -1; }
+    int64_t n = 0;
+    while (n < size) {
+        ssize_t r = read(fd, buf + n, (size_t)(size - n));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        n += r;
+    }
+    close(fd);
+    buf[n] = 0;
+    *out = buf;
+    return n;
+}
+
+static int64_t of_do_pread(of_op *op) {
+    for (;;) {
+        ssize_t r = pread(op->fd, op->buf, (size_t)op->len, (off_t)op->off);
+        if (r < 0 && errno == EINTR) continue;
+        return r < 0 ? -1 : (int64_t)r;
+    }
+}
+
+static void *of_worker(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&of_lock);
+        while (of_q_head < 0) pthread_cond_wait(&of_work, &of_lock);
+        int64_t id = of_q_head;
+        of_q_head = of_ops[id].next;
+        if (of_q_head < 0) of_q_tail = -1;
+        of_ops[id].state = OF_RUNNING;
+        of_op work = of_ops[id];       /* of_ops may be realloc'd while unlocked */
+        pthread_mutex_unlock(&of_lock);
+
+        char *out = work.buf;
+        int64_t result = work.kind == OF_READ_FILE ? of_do_read_file(&work, &out)
+                                                   : of_do_pread(&work);
+
+        int wake = 0;
+        pthread_mutex_lock(&of_lock);
+        of_op *op = &of_ops[id];
+        op->result = result;
+        op->buf = out;
+        op->state = OF_DONE;
+        if (op->parked) {
+            if (of_push(&of_ready, &of_ready_count, &of_ready_cap, op->token))
+                op->reported = 1;
+            else
+                of_ready_lost = 1;
+            wake = 1;
+        }
+        pthread_cond_broadcast(&of_done);
+        pthread_mutex_unlock(&of_lock);
+        if (wake) {
+            char b = 1;
+            while (write(of_pipe[1], &b, 1) < 0 && errno == EINTR) {}
+        }
+    }
+    return NULL;
+}
+
+/* Called with of_lock held. */
+static int of_start(void) {
+    if (of_started) return of_started > 0;
+    of_started = -1;
+    if (pipe(of_pipe) != 0) return 0;
+    of_set_nonblock(of_pipe[0]);
+    of_set_nonblock(of_pipe[1]);
+    int want = 4;
+    const char *env = getenv("SAFFRON_BLOCKING_THREADS");
+    if (env && atoi(env) > 0) want = atoi(env);
+    if (want > OF_MAX_THREADS) want = OF_MAX_THREADS;
+    int running = 0;
+    for (int i = 0; i < want; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, of_worker, NULL) == 0) {
+            pthread_detach(tid);
+            running++;
+        }
+    }
+    if (running == 0) {
+        close(of_pipe[0]);
+        close(of_pipe[1]);
+        of_pipe[0] = of_pipe[1] = -1;
+        return 0;
+    }
+    of_started = 1;
+    return 1;
+}
+
+/* Allocate and queue an op; returns its id or -1. Called with of_lock held. */
+static int64_t of_submit(of_op *proto) {
+    if (!of_start()) return -1;
+    int64_t id = of_free_head;
+    if (id >= 0) {
+        of_free_head = of_ops[id].next;
+    } else {
+        if (of_nops == of_cap) {
+            int64_t cap = of_cap ? of_cap * 2 : 64;
+            of_op *grown = realloc(of_ops, (size_t)cap * sizeof(of_op));
+            if (!grown) return -1;
+            of_ops = grown;
+            of_cap = cap;
+        }
+        id = of_nops++;
+    }
+    of_ops[id] = *proto;
+    of_ops[id].state = OF_QUEUED;
+    of_ops[id].next = -1;
+    if (of_q_tail >= 0) of_ops[of_q_tail].next = id; else of_q_head = id;
+    of_q_tail = id;
+    pthread_cond_signal(&of_work);
+    return id;
+}
+
+/*
+ * sf_offload_in_task — The scheduler sets 1 while it is resuming a task and 0
+ * after. Submits outside a task return -1.
+ */
+void sf_offload_in_task(int64_t on) {
+    of_task_depth = on ? 1 : 0;
+}
+
+/* Read the whole of `path` on a helper. -1 = not offloaded; read it directly. */
+int64_t sf_offload_read_file(const char *path) {
+    if (!of_task_depth || !path) return -1;
+    of_op proto;
+    memset(&proto, 0, sizeof(proto));
+    proto.kind = OF_READ_FILE;
+    proto.path = strdup(path);
+    if (!proto.path) return -1;
+    pthread_mutex_lock(&of_lock);
+    int64_t id = of_submit(&proto);
+    pthread_mutex_unlock(&of_lock);
+    if (id < 0) free(proto.path);
+    return id;
+}
+
+/* pread(fd, buf, len, off) on a helper. `buf` must stay valid until the op is
+ * done. -1 = not offloaded. */
+int64_t sf_offload_pread(int64_t fd, char *buf, int64_t len, int64_t off) {
+    if (!of_task_depth || fd < 0 || !buf || len <= 0) return -1;
+    of_op proto;
+    memset(&proto, 0, sizeof(proto));
+    proto.kind = OF_PREAD;
+    proto.fd = (int)fd;
+    proto.buf = buf;
+    proto.len = len;
+    proto.off = off;
+    pthread_mutex_lock(&of_lock);
+    int64_t id = of_submit(&proto);
+    pthread_mutex_unlock(&of_lock);
+    return id;
+}
+
+/*
+ * sf_offload_park — Park task `token` on `op`. Returns 1 if the op is already
+ * done (re-queue the task now), 0 if its handle will come out of
+ * sf_offload_drain() later.
+ */
+int64_t sf_offload_park(int64_t op, int64_t token) {
+    int64_t done = 1;
+    pthread_mutex_lock(&of_lock);
+    if (op >= 0 && op < of_nops && of_ops[op].state != OF_FREE && of_ops[op].state != OF_DONE) {
+        of_ops[op].parked = 1;
+        of_ops[op].token = token;
+        done = 0;
+    }
+    pthread_mutex_unlock(&of_lock);
+    return done;
+}
+
+/* The fd the scheduler watches for completions of parked ops, or -1. */
+int64_t sf_offload_fd(void) {
+    return of_started > 0 ? of_pipe[0] : -1;
+}
+
+/*
+ * sf_offload_drain — Empty the wake pipe and collect the handles of parked ops
+ * that have completed. Returns how many; read them with sf_offload_ready(i).
+ */
+int64_t sf_offload_drain(void) {
+    if (of_started <= 0) return 0;
+    char sink[64];
+    while (read(of_pipe[0], sink, sizeof(sink)) > 0) {}
+    pthread_mutex_lock(&of_lock);
+    int64_t *t = of_snap;
+    int64_t t_cap = of_snap_cap;
+    of_snap = of_ready;
+    of_snap_cap = of_ready_cap;
+    of_snap_count = of_ready_count;
+    of_ready = t;
+    of_ready_cap = t_cap;
+    of_ready_count = 0;
+    int retry = 0;
+    if (of_ready_lost) {
+        of_ready_lost = 0;
+        for (int64_t i = 0; i < of_nops; i++) {
+            of_op *op = &of_ops[i];
+            if (op->state != OF_DONE || !op->parked || op->reported) continue;
+            if (!of_push(&of_snap, &of_snap_count, &of_snap_cap, op->token)) {
+                of_ready_lost = 1;          /* still short: come back later */
+                retry = 1;
+                break;
+            }
+            op->reported = 1;
+        }
+    }
+    pthread_mutex_unlock(&of_lock);
+    if (retry) {
+        char b = 1;
+        while (write(of_pipe[1], &b, 1) < 0 && errno == EINTR) {}
+    }
+    return of_snap_count;
+}
+
+int64_t sf_offload_ready(int64_t i) {
+    return (i >= 0 && i < of_snap_count) ? of_snap[i] : -1;
+}
+
+/* Block until `op` is done and return its result: bytes read, or -1. */
+int64_t sf_offload_result(int64_t op) {
+    int64_t r = -1;
+    pthread_mutex_lock(&of_lock);
+    if (op >= 0 && op < of_nops && of_ops[op].state != OF_FREE) {
+        while (of_ops[op].state != OF_DONE) pthread_cond_wait(&of_done, &of_lock);
+        r = of_ops[op].result;
+    }
+    pthread_mutex_unlock(&of_lock);
+    return r;
+}
+
+/*
+ * sf_offload_finish — Free a done op. For a whole-file read, returns the
+ * NUL-terminated buffer (the caller owns it; NULL if the read failed); for a
+ * pread, NULL. Call after sf_offload_result().
+ */
+char *sf_offload_finish(int64_t op) {
+    char *buf = NULL;
+    pthread_mutex_lock(&of_lock);
+    if (op >= 0 && op < of_nops && of_ops[op].state == OF_DONE) {
+        if (of_ops[op].kind == OF_READ_FILE) buf = of_ops[op].buf;
+        free(of_ops[op].path);
+        memset(&of_ops[op], 0, sizeof(of_op));
+        of_ops[op].state = OF_FREE;
+        of_ops[op].next = of_free_head;
+        of_free_head = op;
+    }
+    pthread_mutex_unlock(&of_lock);
+    return buf;
+}
@@ -0,0 +1,384 @@
+/*
+ * Saffron Runtime: I/O Readiness Reactor
+ * ======================================
+ *
+ * The scheduler (src/lib/scheduler.sf) parks a task on an fd with
+ * sf_reactor_arm() and, when it has nothing runnable, blocks once in
+ * sf_reactor_wait() until some parked fd is ready or the nearest timer is due.
+ * One wait is one syscall however many fds are parked, so 10k idle keep-alive
+ * connections cost nothing per tick — the old path polled every parked fd on
+ * every tick.
+ *
+ * Backends:
+ *   Linux   epoll, each fd registered once with EPOLLONESHOT and re-armed with
+ *           EPOLL_CTL_MOD only when a task parks on it again.
+ *   Darwin  kqueue, EV_ADD|EV_ONESHOT. Arming only appends to a change list
+ *           that the next kevent() call submits, so parking is syscall-free.
+ *   other   poll() over the fds that currently have waiters.
+ *
+ * Tokens: a waiter is identified by an opaque int64 token chosen by the
+ * scheduler (its task record id). sf_reactor_wait() hands back the tokens of
+ * the waiters it woke, in no particular order; a token stays valid until its
+ * waiter is delivered or cancelled.
+ *
+ * One-shot arming sidesteps stale registrations: after an event fires the fd is
+ * disarmed in the kernel, and a waiter cancelled on timeout clears our record
+ * of what is armed, so the next park always re-arms. If the fd was closed and
+ * its number reused in between, EPOLL_CTL_MOD fails with ENOENT and the fd is
+ * added afresh.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define SF_REACTOR_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#define SF_REACTOR_KQUEUE 1
+#endif
+
+#define RX_READ  1
+#define RX_WRITE 2
+#define RX_MAX_EVENTS 256
+
+typedef struct {
+    int64_t token;
+    int mode;                /* RX_READ or RX_WRITE */
+} rx_waiter;
+
+typedef struct {
+    rx_waiter *waiters;
+    int count;
+    int cap;
+    int armed;               /* directions armed in the kernel right now */
+    int registered;          /* epoll: fd has been EPOLL_CTL_ADDed */
+} rx_slot;
+
+static rx_slot *rx_slots = NULL;     /* indexed by fd */
+static int rx_nslots = 0;
+static int rx_backend_fd = -2;       /* -2 = not initialised, -1 = poll() fallback */
+static int64_t rx_waiting = 0;       /* total parked waiters */
+
+static int64_t *rx_ready = NULL;     /* tokens woken by the last wait */
+static int rx_ready_count = 0;
+static int rx_ready_cap = 0;
+
+#if SF_REACTOR_KQUEUE
+static struct kevent *rx_changes = NULL;
+static int rx_nchanges = 0;
+static int rx_changes_cap = 0;
+#endif
+
+static void rx_init(void) {
+    if (rx_backend_fd != -2) return;
+#if SF_REACTOR_EPOLL
+    rx_backend_fd = epoll_create1(EPOLL_CLOEXEC);
+#elif SF_REACTOR_KQUEUE
+    rx_backend_fd = kqueue();
+#else
+    rx_backend_fd = -1;
+#endif
+    if (rx_backend_fd < 0) rx_backend_fd = -1;
+}
+
+static rx_slot *rx_slot_for(int fd) {
+    if (fd >= rx_nslots) {
+        int n = rx_nslots ? rx_nslots : 64;
+        while (n <= fd) n *= 2;
+        rx_slot *grown = realloc(rx_slots, (size_t)n * sizeof(rx_slot));
+        if (!grown) return NULL;
+        memset(grown + rx_nslots, 0, (size_t)(n - rx_nslots) * sizeof(rx_slot));
+        rx_slots = grown;
+        rx_nslots = n;
+    }
+    return &rx_slots[fd];
+}
+
+static int rx_wanted(const rx_slot *s) {
+    int m = 0;
+    for (int i = 0; i < s->count; i++) m |= s->waiters[i].mode;
+    return m;
+}
+
+static void rx_push_ready(int64_t token) {
+    if (rx_ready_count == rx_ready_cap) {
+        int n = rx_ready_cap ? rx_ready_cap * 2 : 64;
+        int64_t *grown = realloc(rx_ready, (size_t)n * sizeof(int64_t));
+        if (!grown) return;
+        rx_ready = grown;
+        rx_ready_cap = n;
+    }
+    rx_ready[rx_ready_count++] = token;
+}
+
+/* Wake every waiter on `fd` whose direction is in `modes`. */
+static void rx_deliver(int fd, int modes) {
+    if (fd < 0 || fd >= rx_nslots) return;
+    rx_slot *s = &rx_slots[fd];
+    int i = 0;
+    while (i < s->count) {
+        if (s->waiters[i].mode & modes) {
+            rx_push_ready(s->waiters[i].token);
+            s->waiters[i] = s->waiters[--s->count];
+            rx_waiting--;
+        } else {
+            i++;
+        }
+    }
+}
+
+/* ===== Kernel arming ===== */
+
+#if SF_REACTOR_EPOLL
+static int rx_kernel_arm(int fd, rx_slot *s, int mask) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLONESHOT | ((mask & RX_READ) ? (EPOLLIN | EPOLLRDHUP) : 0)
+                             | ((mask & RX_WRITE) ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    int op = s->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    int rc = epoll_ctl(rx_backend_fd, op, fd, &ev);
+    if (rc < 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+        rc = epoll_ctl(rx_backend_fd, EPOLL_CTL_ADD, fd, &ev);   /* fd reused */
+    } else if (rc < 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+        rc = epoll_ctl(rx_backend_fd, EPOLL_CTL_MOD, fd, &ev);
+    }
+    if (rc < 0) return -1;
+    s->registered = 1;
+    return 0;
+}
+#elif SF_REACTOR_KQUEUE
+static int rx_kernel_arm(int fd, rx_slot *s, int mask) {
+    int add = mask & ~s->armed;
+    for (int dir = RX_READ; dir <= RX_WRITE; dir <<= 1) {
+        if (!(add & dir)) continue;
+        if (rx_nchanges == rx_changes_cap) {
+            int n = rx_changes_cap ? rx_changes_cap * 2 : 64;
+            struct kevent *grown = realloc(rx_changes, (size_t)n * sizeof(struct kevent));
+            if (!grown) return -1;
+            rx_changes = grown;
+            rx_changes_cap = n;
+        }
+        EV_SET(&rx_changes[rx_nchanges++], (uintptr_t)fd,
+               dir == RX_READ ? EVFILT_READ : EVFILT_WRITE,
+               EV_ADD | EV_ONESHOT, 0, 0, NULL);
+    }
+    s->registered = 1;
+    return 0;
+}
+#else
+static int rx_kernel_arm(int fd, rx_slot *s, int mask) {
+    (void)fd; (void)s; (void)mask;
+    return 0;                /* poll() rebuilds its set on every wait */
+}
+#endif
+
+/* ===== Exports (declared in src/lib/scheduler.sf) ===== */
+
+/*
+ * sf_reactor_arm — Park waiter `token` on `fd` (mode 0 = readable,
+ * 1 = writable). Returns 0 when parked, -1 when the fd cannot be watched
+ * (epoll refuses regular files, for example); the scheduler then resumes the
+ * task straight away, which is what poll() would have reported for such an fd.
+ */
+int64_t sf_reactor_arm(int64_t fd, int64_t mode, int64_t token) {
+    if (fd < 0) return -1;
+    rx_init();
+    rx_slot *s = rx_slot_for((int)fd);
+    if (!s) return -1;
+    int dir = mode == 0 ? RX_READ : RX_WRITE;
+    if (s->count == s->cap) {
+        int n = s->cap ? s->cap * 2 : 2;
+        rx_waiter *grown = realloc(s->waiters, (size_t)n * sizeof(rx_waiter));
+        if (!grown) return -1;
+        s->waiters = grown;
+        s->cap = n;
+    }
+    /* Arm for every direction anyone is waiting on, not just this one: a
+     * cancel may have forgotten what the kernel holds for the other side. */
+    int want = rx_wanted(s) | dir;
+    if (rx_backend_fd >= 0 && (s->armed & dir) == 0) {
+        if (rx_kernel_arm((int)fd, s, want) < 0) return -1;
+    }
+    s->armed = want;
+    s->waiters[s->count].token = token;
+    s->waiters[s->count].mode = dir;
+    s->count++;
+    rx_waiting++;
+    return 0;
+}
+
+/*
+ * sf_reactor_cancel — Drop waiter `token` from `fd` (its deadline passed).
+ * The kernel registration is left to fire or not; an event with no waiter is
+ * ignored. Forgetting what is armed makes the next park on this fd re-arm, so
+ * a closed-and-reused fd number is always registered afresh.
+ */
+void sf_reactor_cancel(int64_t fd, int64_t mode, int64_t token) {
+    if (fd < 0 || fd >= rx_nslots) return;
+    rx_slot *s = &rx_slots[fd];
+    int dir = mode == 0 ? RX_READ : RX_WRITE;
+    for (int i = 0; i < s->count; i++) {
+        if (s->waiters[i].token == token && s->waiters[i].mode == dir) {
+            s->waiters[i] = s->waiters[--s->count];
+            rx_waiting--;
+            break;
+        }
+    }
+    s->armed = 0;
+}
+
+static int rx_wait_poll(int64_t timeout_ms) {
+    struct pollfd stack_fds[64];
+    struct pollfd *fds = stack_fds;
+    int n = 0, cap = 64;
+    for (int fd = 0; fd < rx_nslots; fd++) {
+        if (rx_slots[fd].count == 0) continue;
+        if (n == cap) {
+            int ncap = cap * 2;
+            struct pollfd *grown = malloc((size_t)ncap * sizeof(struct pollfd));
+            if (!grown) break;
+            memcpy(grown, fds, (size_t)n * sizeof(struct pollfd));
+            if (fds != stack_fds) free(fds);
+            fds = grown;
+            cap = ncap;
+        }
+        int want = rx_wanted(&rx_slots[fd]);
+        fds[n].fd = fd;
+        fds[n].events = (short)(((want & RX_READ) ? POLLIN : 0) | ((want & RX_WRITE) ? POLLOUT : 0));
+        fds[n].revents = 0;
+        n++;
+    }
+    int rc = poll(fds, (nfds_t)n, (int)timeout_ms);
+    for (int i = 0; rc > 0 && i < n; i++) {
+        short r = fds[i].revents;
+        if (!r) continue;
+        int modes = 0;
+        if (r & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) modes |= RX_READ;
+        if (r & (POLLOUT | POLLHUP | POLLERR | POLLNVAL)) modes |= RX_WRITE;
+        rx_deliver(fds[i].fd, modes);
+    }
+    if (fds != stack_fds) free(fds);
+    return rc < 0 && errno != EINTR ? -1 : 0;
+}
+
+/*
+ * sf_reactor_wait — Block up to `timeout_ms` (0 = just check, -1 = until
+ * something is ready) and collect the waiters that became ready. Returns how
+ * many; read them with sf_reactor_ready(0 .. n-1). With
+ * nothing parked this is simply a sleep, which is how the scheduler waits for
+ * its next timer.
+ */
+int64_t sf_reactor_wait(int64_t timeout_ms) {
+    rx_init();
+    rx_ready_count = 0;
+    if (timeout_ms > 0x7fffffff) timeout_ms = 0x7fffffff;
+#if SF_REACTOR_EPOLL
+    if (rx_backend_fd >= 0) {
+        struct epoll_event evs[RX_MAX_EVENTS];
+        int n = epoll_wait(rx_backend_fd, evs, RX_MAX_EVENTS, (int)timeout_ms);
+        for (int i = 0; i < n; i++) {
+            int fd = evs[i].data.fd;
+            uint32_t e = evs[i].events;
+            int modes = 0;
+            if (e & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) modes |= RX_READ;
+            if (e & (EPOLLOUT | EPOLLHUP | EPOLLERR)) modes |= RX_WRITE;
+            if (fd < 0 || fd >= rx_nslots) continue;
+            rx_slots[fd].armed = 0;                 /* one-shot: now disarmed */
+            rx_deliver(fd, modes);
+            rx_slot *s = &rx_slots[fd];
+            int rest = rx_wanted(s);
+            if (rest && rx_kernel_arm(fd, s, rest) == 0) s->armed = rest;
+        }
+        goto done;
+    }
+#elif SF_REACTOR_KQUEUE
+    if (rx_backend_fd >= 0) {
+        struct kevent evs[RX_MAX_EVENTS];
+        struct timespec ts, *tsp = NULL;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = (time_t)(timeout_ms / 1000);
+            ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+            tsp = &ts;
+        }
+        int n = kevent(rx_backend_fd, rx_changes, rx_nchanges, evs, RX_MAX_EVENTS, tsp);
+        if (n < 0) {
+            /* EINTR: keep the changes for the next wait to submit again (an
+             * EV_ADD the kernel already took is just updated). Any other
+             * failure refuses the whole list: forget those directions are
+             * armed and wake their waiters, whose retry re-parks and re-arms
+             * or sees the error. Dropping the list alone would leave them
+             * parked on registrations that were never made. */
+            if (errno != EINTR) {
+                int k = rx_nchanges;
+                rx_nchanges = 0;
+                for (int i = 0; i < k; i++) {
+                    int fd = (int)rx_changes[i].ident;
+                    if (fd < 0 || fd >= rx_nslots) continue;
+                    int dir = rx_changes[i].filter == EVFILT_READ ? RX_READ : RX_WRITE;
+                    rx_slots[fd].armed &= ~dir;
+                    rx_deliver(fd, dir);
+                }
+            }
+            goto done;
+        }
+        rx_nchanges = 0;
+        for (int i = 0; i < n; i++) {
+            int fd = (int)evs[i].ident;
+            if (fd < 0 || fd >= rx_nslots) continue;
+            /* EV_ERROR: the change itself failed (bad fd). Wake the waiters so
+             * the task retries its I/O and sees the error directly. */
+            int dir = (evs[i].flags & EV_ERROR) ? (RX_READ | RX_WRITE)
+                    : evs[i].filter == EVFILT_READ ? RX_READ : RX_WRITE;
+            rx_slots[fd].armed &= ~dir;
+            rx_deliver(fd, dir);
+        }
+        goto done;
+    }
+#endif
+    rx_wait_poll(timeout_ms);
+done:
+    return rx_ready_count;
+}
+
+/* sf_reactor_ready — The i-th token woken by the last sf_reactor_wait(). */
+int64_t sf_reactor_ready(int64_t i) {
+    if (i < 0 || i >= rx_ready_count) return -1;
+    return rx_ready[i];
+}
+
+/*
+ * sf_reactor_fd — The epoll/kqueue descriptor, or -1 under the poll()
+ * fallback. It turns readable when a registered fd is ready, which is how the
+ * io_uring backend (uring_native.c) folds readiness waiters into its own wait.
+ */
+int64_t sf_reactor_fd(void) {
+    rx_init();
+    return rx_backend_fd;
+}
+
+/* sf_reactor_waiting — Waiters currently parked. */
+int64_t sf_reactor_waiting(void) {
+    return rx_waiting;
+}
+
+/*
+ * sf_reactor_reset — Forget every waiter (the scheduler's test reset). Kernel
+ * registrations are left to fire into empty slots and be ignored.
+ */
+void sf_reactor_reset(void) {
+    for (int fd = 0; fd < rx_nslots; fd++) {
+        rx_slots[fd].count = 0;
+        rx_slots[fd].armed = 0;
+    }
+    rx_waiting = 0;
+    rx_ready_count = 0;
+}
@@ -0,0 +1,438 @@
+/*
+ * Saffron Runtime: Scheduler Instrumentation
+ * ==========================================
+ *
+ * Off unless asked for. scheduler_tick() in src/lib/scheduler.sf checks one
+ * flag and, only when it is set, reports each step here: a task made runnable,
+ * a task resumed and what it suspended on, a timer fired late, a tick begun
+ * and ended. This file turns those calls into histograms and counters, exposes
+ * them to Scheduler.stats(), and — with SAFFRON_SCHED_TRACE set — prints a
+ * summary of the last interval to stderr:
+ *
+ *   sched 4 ticks=18211 done=6003 busy=412.08ms idle=583.77ms rq avg=3.1 max=41 lag p99=1.05ms max=2.10ms
+ *   sched 4 wait p50=0.13ms p99=4.19ms slice p50=0.02ms p99=0.52ms longest=3.84ms in handle_request.resume
+ *   sched 4 suspends yield=2 sleep=6000 read=5211 await=4 write=0 actor=0 io=3 uring=0 offload=120
+ *
+ * SAFFRON_SCHED_TRACE is the interval in seconds ("1" or "0.25"); "0" or
+ * unset leaves everything off. Scheduler.enable_stats() turns recording on
+ * from code without the dump.
+ *
+ * What is measured:
+ *   tick      busy part of a tick that resumed a task: from the start of the
+ *             tick, or the end of its blocking reactor wait, to the task's
+ *             bookkeeping done. Time blocked in the wait is counted as idle.
+ *   lag       how late each timer fired (sleep and IO deadlines) — the
+ *             event-loop lag a long-running task causes everyone else. A
+ *             deadline is set from the start of the tick that armed it, so a
+ *             sleeper's own slice before it slept counts toward its lag.
+ *   wait      each stretch a task spent runnable before it was resumed.
+ *   slice     each uninterrupted run of a task, resume to suspend. The longest
+ *             is kept with the task's entry function: the coroutine's resume
+ *             function, named through dladdr(3) when the symbol is visible and
+ *             printed as an address otherwise.
+ *   task_runnable / task_running
+ *             the totals of those two for each task, recorded when it finishes.
+ *
+ * Histograms are the same power-of-two buckets as gctrace_native.c: exact
+ * count, total and max; p50/p99 as the upper edge of their bucket.
+ *
+ * Single-threaded: only the thread holding the GRL runs the scheduler.
+ */
+
+/* Dl_info / dladdr are GNU extensions in glibc's <dlfcn.h>. */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#define SS_BUCKETS 65
+#define SS_REASONS 10
+
+typedef struct {
+    uint64_t buckets[SS_BUCKETS];
+    int64_t count;
+    int64_t total_ns;
+    int64_t max_ns;
+} ss_hist;
+
+/* Histogram ids — the order sf_sched_stats_get() and scheduler.sf agree on. */
+enum {
+    SS_TICK,
+    SS_LAG,
+    SS_WAIT,
+    SS_SLICE,
+    SS_TASK_RUNNABLE,
+    SS_TASK_RUNNING,
+    SS_HIST_COUNT
+};
+
+/* Per-histogram statistics. */
+enum {
+    SS_STAT_COUNT,
+    SS_STAT_TOTAL,
+    SS_STAT_P50,
+    SS_STAT_P99,
+    SS_STAT_MAX
+};
+
+/* Counter ids for sf_sched_stats_counter(); suspends by reason follow. */
+enum {
+    SS_C_TICKS,
+    SS_C_RESUMES,
+    SS_C_COMPLETED,
+    SS_C_BUSY_NS,
+    SS_C_IDLE_NS,
+    SS_C_RQ_MAX,
+    SS_C_RQ_SUM,
+    SS_C_LONGEST_NS,
+    SS_C_SUSPENDS,
+    SS_C_COUNT = SS_C_SUSPENDS + SS_REASONS
+};
+
+typedef struct {
+    ss_hist hists[SS_HIST_COUNT];
+    int64_t counters[SS_C_COUNT];
+    void *longest_entry;
+} ss_stats;
+
+/* Since start (or sf_sched_stats_reset), and since the last trace line. */
+static ss_stats ss_total, ss_window;
+static int ss_on = 0;
+static int64_t ss_interval_ns = 0;      /* trace period; 0 = no trace */
+static int64_t ss_last_dump_ns = 0;
+static int64_t ss_dump_seq = 0;
+
+/* The task being run and when it started; when the current tick started. */
+static int64_t ss_tick_start = 0;
+static int64_t ss_run_start = 0;
+static void *ss_run_entry = NULL;
+
+static int64_t ss_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int ss_bucket(int64_t ns) {
+    if (ns <= 0) return 0;
+    return 64 - __builtin_clzll((uint64_t)ns);
+}
+
+static void ss_hist_add(ss_hist *h, int64_t ns) {
+    if (ns < 0) ns = 0;
+    h->buckets[ss_bucket(ns)]++;
+    h->count++;
+    h->total_ns += ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+}
+
+static int64_t ss_percentile(const ss_hist *h, int permille) {
+    if (h->count == 0) return 0;
+    int64_t want = (h->count * permille + 999) / 1000;
+    if (want < 1) want = 1;
+    int64_t seen = 0;
+    for (int b = 0; b < SS_BUCKETS; b++) {
+        seen += (int64_t)h->buckets[b];
+        if (seen >= want) {
+            int64_t upper = b == 0 ? 0 : (b >= 63 ? INT64_MAX : ((int64_t)1 << b) - 1);
+            return upper < h->max_ns ? upper : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+/* Record into both the running totals and the trace window. */
+static void ss_add(int hist, int64_t ns) {
+    ss_hist_add(&ss_total.hists[hist], ns);
+    ss_hist_add(&ss_window.hists[hist], ns);
+}
+
+static void ss_count(int counter, int64_t n) {
+    ss_total.counters[counter] += n;
+    ss_window.counters[counter] += n;
+}
+
+static void ss_raise(int counter, int64_t v) {
+    if (v > ss_total.counters[counter]) ss_total.counters[counter] = v;
+    if (v > ss_window.counters[counter]) ss_window.counters[counter] = v;
+}
+
+/* ===== Per-task accounting ===== */
+
+/*
+ * Open addressing keyed by task handle, linear probing, backward-shift
+ * deletion (the same scheme as the result table in async_native.c). An entry
+ * lives from the task's first appearance until it finishes; tasks that were
+ * already parked when recording started get one when they are next resumed.
+ */
+typedef struct {
+    int64_t handle;          /* 0 = empty */
+    int64_t ready_ns;        /* when it became runnable; 0 while not runnable */
+    int64_t runnable_ns;
+    int64_t running_ns;
+} ss_task;
+
+static ss_task *ss_tasks = NULL;
+static int64_t ss_task_cap = 0;
+static int64_t ss_task_count = 0;
+
+static int64_t ss_hash(int64_t handle) {
+    uint64_t h = (uint64_t)handle;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (int64_t)(h & (uint64_t)(ss_task_cap - 1));
+}
+
+static int ss_task_grow(void) {
+    int64_t old_cap = ss_task_cap;
+    ss_task *old = ss_tasks;
+    int64_t cap = old_cap ? old_cap * 2 : 256;
+    ss_task *t = calloc((size_t)cap, sizeof(ss_task));
+    if (!t) return 0;
+    ss_tasks = t;
+    ss_task_cap = cap;
+    for (int64_t i = 0; i < old_cap; i++) {
+        if (!old[i].handle) continue;
+        int64_t j = ss_hash(old[i].handle);
+        while (ss_tasks[j].handle) j = (j + 1) & (cap - 1);
+        ss_tasks[j] = old[i];
+    }
+    free(old);
+    return 1;
+}
+
+/* The entry for `handle`, made if missing; NULL only when out of memory. */
+static ss_task *ss_task_get(int64_t handle) {
+    if ((ss_task_count + 1) * 4 > ss_task_cap * 3 && !ss_task_grow()) return NULL;
+    int64_t i = ss_hash(handle);
+    while (ss_tasks[i].handle) {
+        if (ss_tasks[i].handle == handle) return &ss_tasks[i];
+        i = (i + 1) & (ss_task_cap - 1);
+    }
+    memset(&ss_tasks[i], 0, sizeof(ss_task));
+    ss_tasks[i].handle = handle;
+    ss_task_count++;
+    return &ss_tasks[i];
+}
+
+static void ss_task_remove(ss_task *t) {
+    int64_t mask = ss_task_cap - 1;
+    int64_t hole = t - ss_tasks;
+    int64_t i = (hole + 1) & mask;
+    while (ss_tasks[i].handle) {
+        int64_t home = ss_hash(ss_tasks[i].handle);
+        /* Move i into the hole unless its home lies cyclically in (hole, i]. */
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            ss_tasks[hole] = ss_tasks[i];
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+    ss_tasks[hole].handle = 0;
+    ss_task_count--;
+}
+
+/* ===== Trace output ===== */
+
+static void ss_fmt_ms(char *buf, size_t n, int64_t ns) {
+    snprintf(buf, n, "%.2fms", (double)ns / 1e6);
+}
+
+static void ss_fmt_entry(char *buf, size_t n, void *entry) {
+    Dl_info info;
+    if (!entry) {
+        snprintf(buf, n, "?");
+    } else if (dladdr(entry, &info) && info.dli_sname && info.dli_saddr == entry) {
+        snprintf(buf, n, "%s", info.dli_sname);
+    } else {
+        snprintf(buf, n, "0x%llx", (unsigned long long)(uintptr_t)entry);
+    }
+}
+
+static void ss_dump(const ss_stats *s) {
+    static const char *names[SS_REASONS] = {
+        "yield", "sleep", "read", "await", "write", "actor", "io", "uring", "offload",
+        "park"
+    };
+    char busy[32], idle[32], lag99[32], lagmax[32], w50[32], w99[32];
+    char s50[32], s99[32], longest[32], entry[256];
+    const int64_t *c = s->counters;
+    int64_t resumes = c[SS_C_RESUMES];
+    ss_dump_seq++;
+    ss_fmt_ms(busy, sizeof(busy), c[SS_C_BUSY_NS]);
+    ss_fmt_ms(idle, sizeof(idle), c[SS_C_IDLE_NS]);
+    ss_fmt_ms(lag99, sizeof(lag99), ss_percentile(&s->hists[SS_LAG], 990));
+    ss_fmt_ms(lagmax, sizeof(lagmax), s->hists[SS_LAG].max_ns);
+    ss_fmt_ms(w50, sizeof(w50), ss_percentile(&s->hists[SS_WAIT], 500));
+    ss_fmt_ms(w99, sizeof(w99), ss_percentile(&s->hists[SS_WAIT], 990));
+    ss_fmt_ms(s50, sizeof(s50), ss_percentile(&s->hists[SS_SLICE], 500));
+    ss_fmt_ms(s99, sizeof(s99), ss_percentile(&s->hists[SS_SLICE], 990));
+    ss_fmt_ms(longest, sizeof(longest), c[SS_C_LONGEST_NS]);
+    ss_fmt_entry(entry, sizeof(entry), s->longest_entry);
+    fprintf(stderr, "sched %lld ticks=%lld done=%lld busy=%s idle=%s rq avg=%.1f max=%lld lag p99=%s max=%s\n",
+            (long long)ss_dump_seq, (long long)c[SS_C_TICKS], (long long)c[SS_C_COMPLETED],
+            busy, idle, resumes > 0 ? (double)c[SS_C_RQ_SUM] / (double)resumes : 0.0,
+            (long long)c[SS_C_RQ_MAX], lag99, lagmax);
+    fprintf(stderr, "sched %lld wait p50=%s p99=%s slice p50=%s p99=%s longest=%s in %s\n",
+            (long long)ss_dump_seq, w50, w99, s50, s99, longest, entry);
+    fprintf(stderr, "sched %lld suspends", (long long)ss_dump_seq);
+    for (int r = 0; r < SS_REASONS; r++) {
+        fprintf(stderr, " %s=%lld", names[r], (long long)c[SS_C_SUSPENDS + r]);
+    }
+    fputc('\n', stderr);
+}
+
+static void ss_maybe_dump(int64_t now) {
+    if (ss_interval_ns <= 0 || now - ss_last_dump_ns < ss_interval_ns) return;
+    ss_last_dump_ns = now;
+    ss_dump(&ss_window);
+    memset(&ss_window, 0, sizeof(ss_window));
+}
+
+static void ss_dump_at_exit(void) {
+    if (ss_window.counters[SS_C_TICKS] > 0) ss_dump(&ss_window);
+}
+
+/* ===== Hooks from scheduler.sf (only called while recording is on) ===== */
+
+int64_t sf_sched_stats_on(void) {
+    return ss_on;
+}
+
+void sf_sched_stats_enable(int64_t on) {
+    ss_on = on != 0;
+}
+
+void sf_sched_stat_tick_begin(void) {
+    ss_tick_start = ss_now_ns();
+}
+
+/* The tick's blocking reactor wait just returned: that much was idle. */
+void sf_sched_stat_woke(void) {
+    int64_t now = ss_now_ns();
+    ss_count(SS_C_IDLE_NS, now - ss_tick_start);
+    ss_tick_start = now;
+}
+
+void sf_sched_stat_ready(int64_t handle) {
+    ss_task *t = ss_task_get(handle);
+    if (t) t->ready_ns = ss_now_ns();
+}
+
+/* `handle` is about to be resumed; `depth` tasks were runnable, it included. */
+void sf_sched_stat_run(int64_t handle, int64_t depth) {
+    int64_t now = ss_now_ns();
+    ss_task *t = ss_task_get(handle);
+    if (t && t->ready_ns > 0) {
+        int64_t waited = now - t->ready_ns;
+        ss_add(SS_WAIT, waited);
+        t->runnable_ns += waited;
+        t->ready_ns = 0;
+    }
+    ss_count(SS_C_RESUMES, 1);
+    ss_count(SS_C_RQ_SUM, depth);
+    ss_raise(SS_C_RQ_MAX, depth);
+    /* Slot 0 of a frame is its resume function, until it finishes. */
+    ss_run_entry = handle ? *(void **)(intptr_t)handle : NULL;
+    ss_run_start = ss_now_ns();
+}
+
+/* The resume returned: suspended with yield `reason`, or finished (-1). */
+void sf_sched_stat_ran(int64_t handle, int64_t reason) {
+    int64_t slice = ss_now_ns() - ss_run_start;
+    ss_add(SS_SLICE, slice);
+    if (slice > ss_total.counters[SS_C_LONGEST_NS]) ss_total.longest_entry = ss_run_entry;
+    if (slice > ss_window.counters[SS_C_LONGEST_NS]) ss_window.longest_entry = ss_run_entry;
+    ss_raise(SS_C_LONGEST_NS, slice);
+    ss_task *t = ss_task_get(handle);
+    if (t) t->running_ns += slice;
+    if (reason < 0) {
+        ss_count(SS_C_COMPLETED, 1);
+        if (t) {
+            ss_add(SS_TASK_RUNNABLE, t->runnable_ns);
+            ss_add(SS_TASK_RUNNING, t->running_ns);
+            ss_task_remove(t);
+        }
+    } else if (reason < SS_REASONS) {
+        ss_count(SS_C_SUSPENDS + (int)reason, 1);
+    }
+}
+
+/* A timer due at some deadline fired `late_secs` after it. */
+void sf_sched_stat_lag(double late_secs) {
+    ss_add(SS_LAG, (int64_t)(late_secs * 1e9));
+}
+
+void sf_sched_stat_tick_end(void) {
+    int64_t now = ss_now_ns();
+    int64_t busy = now - ss_tick_start;
+    ss_add(SS_TICK, busy);
+    ss_count(SS_C_TICKS, 1);
+    ss_count(SS_C_BUSY_NS, busy);
+    ss_maybe_dump(now);
+}
+
+/* ===== Exports (declared in src/lib/scheduler.sf) ===== */
+
+/*
+ * sf_sched_stats_get — One statistic of one histogram:
+ * which = histogram id * 8 + statistic id (see the enums above). Unknown ids
+ * return 0.
+ */
+int64_t sf_sched_stats_get(int64_t which) {
+    int64_t h = which / 8, s = which % 8;
+    if (which < 0 || h >= SS_HIST_COUNT) return 0;
+    const ss_hist *g = &ss_total.hists[h];
+    switch (s) {
+    case SS_STAT_COUNT: return g->count;
+    case SS_STAT_TOTAL: return g->total_ns;
+    case SS_STAT_P50: return ss_percentile(g, 500);
+    case SS_STAT_P99: return ss_percentile(g, 990);
+    case SS_STAT_MAX: return g->max_ns;
+    default: return 0;
+    }
+}
+
+/* sf_sched_stats_counter — one counter (see the counter enum); 0 if unknown. */
+int64_t sf_sched_stats_counter(int64_t id) {
+    if (id < 0 || id >= SS_C_COUNT) return 0;
+    return ss_total.counters[id];
+}
+
+/* Mean run-queue depth seen at each resume; 0.0 before the first. */
+double sf_sched_stats_rq_avg(void) {
+    int64_t n = ss_total.counters[SS_C_RESUMES];
+    return n > 0 ? (double)ss_total.counters[SS_C_RQ_SUM] / (double)n : 0.0;
+}
+
+/* The longest slice's entry function, as a fresh malloc'd string. */
+char *sf_sched_stats_longest_entry(void) {
+    char buf[256];
+    if (!ss_total.longest_entry) buf[0] = '\0';
+    else ss_fmt_entry(buf, sizeof(buf), ss_total.longest_entry);
+    return strdup(buf);
+}
+
+/* Forget everything recorded so far (the trace sequence numbers keep going). */
+void sf_sched_stats_reset(void) {
+    memset(&ss_total, 0, sizeof(ss_total));
+    memset(&ss_window, 0, sizeof(ss_window));
+}
+
+__attribute__((constructor)) static void ss_init(void) {
+    const char *t = getenv("SAFFRON_SCHED_TRACE");
+    if (!t || !*t) return;
+    double secs = strtod(t, NULL);
+    if (secs <= 0.0) return;
+    ss_on = 1;
+    ss_interval_ns = (int64_t)(secs * 1e9);
+    ss_last_dump_ns = ss_now_ns();
+    atexit(ss_dump_at_exit);
+}
@@ -26,6 +26,10 @@
  * fixed-size table of SSL* pointers.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* recvmmsg / sendmmsg */
+#endif
+
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -582,17 +586,14 @@ int64_t sf_udp_socket(void) {
  *
  * Returns: bytes sent on success, -1 for would_block, -2 for error.
  */
-int64_t sf_udp_sendto(int64_t fd, const char *buf, int64_t len, const char *host, int64_t port) {
-    if (fd < 0 || buf == NULL || len <= 0 || host == NULL) return -2;
-    if (port < 0 || port > 65535) return -2;
-
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons((uint16_t)port);
+static int udp_dest(const char *host, int64_t port, struct sockaddr_in *addr) {
+    if (host == NULL || port < 0 || port > 65535) return -1;
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons((uint16_t)port);
 
     /* Convert IP string to binary. For DNS we always send to an IP address. */
-    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+    if (inet_pton(AF_INET, host, &addr->sin_addr) != 1) {
         /* If not a valid IP, try getaddrinfo as fallback */
         char port_str[8];
         snprintf(port_str, sizeof(port_str), "%d", (int)port);
@@ -602,11 +603,19 @@ int64_t sf_udp_sendto(int64_t fd, const char *buf, int64_t len, const char *host
         hints.ai_socktype = SOCK_DGRAM;
         struct addrinfo *result = NULL;
         if (getaddrinfo(host, port_str, &hints, &result) != 0 || result == NULL) {
-            return -2;
+            return -1;
         }
-        memcpy(&addr, result->ai_addr, sizeof(addr));
+        memcpy(addr, result->ai_addr, sizeof(*addr));
         freeaddrinfo(result);
     }
+    return 0;
+}
+
+int64_t sf_udp_sendto(int64_t fd, const char *buf, int64_t len, const char *host, int64_t port) {
+    if (fd < 0 || buf == NULL || len <= 0) return -2;
+
+    struct sockaddr_in addr;
+    if (udp_dest(host, port, &addr) != 0) return -2;
 
     ssize_t n = sendto((int)fd, buf, (size_t)len, 0,
                        (struct sockaddr *)&addr, sizeof(addr));
@@ -640,6 +649,239 @@ int64_t sf_udp_recvfrom(int64_t fd, char *buf, int64_t len) {
     return -2;
 }
 
+/*
+ * Create a non-blocking UDP socket bound to host:port, for receiving. Port 0
+ * binds any free port; sf_udp_local_port() says which.
+ *
+ * Returns: fd on success, -1 on error.
+ */
+static int64_t udp_bind(const char *host, int64_t port, int reuseport) {
+    if (host == NULL) return -1;
+    if (port < 0 || port > 65535) return -1;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) return -1;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) return -1;
+
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#ifdef SO_REUSEPORT
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) != 0) {
+        close(fd);
+        return -1;
+    }
+#else
+    if (reuseport) {
+        close(fd);
+        return -1;
+    }
+#endif
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        set_nonblocking(fd) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return (int64_t)fd;
+}
+
+int64_t sf_udp_bind(const char *host, int64_t port) {
+    return udp_bind(host, port, 0);
+}
+
+/*
+ * As sf_udp_bind, with SO_REUSEPORT set, so several sockets can bind the same
+ * host:port. Linux spreads incoming datagrams across them by a hash of the
+ * sender's address, which lets one task (or thread) per socket share the load.
+ * Other systems allow the bind but may deliver everything to one socket.
+ *
+ * Returns: fd on success, -1 on error (including no SO_REUSEPORT).
+ */
+int64_t sf_udp_bind_shared(const char *host, int64_t port) {
+    return udp_bind(host, port, 1);
+}
+
+/*
+ * The local port a socket is bound to.
+ *
+ * Returns: the port, or -1 on error.
+ */
+int64_t sf_udp_local_port(int64_t fd) {
+    if (fd < 0) return -1;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname((int)fd, (struct sockaddr *)&addr, &addr_len) != 0) return -1;
+    return (int64_t)ntohs(addr.sin_port);
+}
+
+/*
+ * sf_udp_recvfrom, also reporting the sender: "a.b.c.d:port" is written to
+ * `peer` (at least 22 bytes), so a server can sf_udp_sendto() a reply.
+ *
+ * Returns: as sf_udp_recvfrom.
+ */
+int64_t sf_udp_recvfrom_peer(int64_t fd, char *buf, int64_t len, char *peer) {
+    if (fd < 0 || buf == NULL || len <= 0 || peer == NULL) return -2;
+
+    struct sockaddr_in sender_addr;
+    socklen_t addr_len = sizeof(sender_addr);
+
+    ssize_t n = recvfrom((int)fd, buf, (size_t)len, 0,
+                         (struct sockaddr *)&sender_addr, &addr_len);
+    if (n >= 0) {
+        char ip[INET_ADDRSTRLEN];
+        if (inet_ntop(AF_INET, &sender_addr.sin_addr, ip, sizeof(ip)) == NULL) {
+            ip[0] = '\0';
+        }
+        snprintf(peer, 22, "%s:%d", ip, (int)ntohs(sender_addr.sin_port));
+        return (int64_t)n;
+    }
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return -1;
+    if (errno == EINTR) return -1;
+    return -2;
+}
+
+/*
+ * Batched UDP: many datagrams per system call.
+ *
+ * Receiving, `arena` is cut into `max` slots of `slot` bytes, and datagram i
+ * lands in slot i (a longer one is truncated to the slot). For each datagram,
+ * `table` gets four words: offset into the arena, length, sender IPv4 address
+ * (host byte order) and sender port. Sending, `table` holds two words per
+ * datagram, an offset and a length into `arena`, and every datagram goes to
+ * the same host:port.
+ *
+ * On Linux these are recvmmsg(2)/sendmmsg(2), SF_UDP_BATCH datagrams per call.
+ * Elsewhere they loop over recvfrom/sendto: still one call from Saffron, and
+ * still no allocation per datagram.
+ */
+
+#define SF_UDP_BATCH 64
+
+/*
+ * Receive up to `max` datagrams without blocking.
+ *
+ * Returns: the number received (> 0), -1 if none was waiting, -2 on error.
+ */
+int64_t sf_udp_recv_many(int64_t fd, char *arena, int64_t slot, int64_t max, int64_t *table) {
+    if (fd < 0 || arena == NULL || table == NULL || slot <= 0 || max <= 0) return -2;
+
+    int64_t got = 0;
+#if defined(__linux__)
+    struct mmsghdr msgs[SF_UDP_BATCH];
+    struct iovec iovs[SF_UDP_BATCH];
+    struct sockaddr_in from[SF_UDP_BATCH];
+    while (got < max) {
+        int want = (int)(max - got < SF_UDP_BATCH ? max - got : SF_UDP_BATCH);
+        memset(msgs, 0, sizeof(struct mmsghdr) * (size_t)want);
+        for (int i = 0; i < want; i++) {
+            iovs[i].iov_base = arena + (got + i) * slot;
+            iovs[i].iov_len = (size_t)slot;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &from[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        }
+        int n = recvmmsg((int)fd, msgs, (unsigned int)want, MSG_DONTWAIT, NULL);
+        if (n < 0) break;
+        for (int i = 0; i < n; i++) {
+            int64_t *row = table + (got + i) * 4;
+            int64_t len = (int64_t)msgs[i].msg_len;
+            row[0] = (got + i) * slot;
+            row[1] = len < slot ? len : slot;
+            row[2] = (int64_t)ntohl(from[i].sin_addr.s_addr);
+            row[3] = (int64_t)ntohs(from[i].sin_port);
+        }
+        got += n;
+        if (n < want) break;   /* the socket is drained */
+    }
+#else
+    while (got < max) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom((int)fd, arena + got * slot, (size_t)slot, 0,
+                             (struct sockaddr *)&from, &from_len);
+        if (n < 0) break;
+        int64_t *row = table + got * 4;
+        row[0] = got * slot;
+        row[1] = (int64_t)n;
+        row[2] = (int64_t)ntohl(from.sin_addr.s_addr);
+        row[3] = (int64_t)ntohs(from.sin_port);
+        got++;
+    }
+#endif
+    if (got > 0) return got;
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return -1;
+    return -2;
+}
+
+/*
+ * Send `count` datagrams to host:port without blocking.
+ *
+ * Returns: the number sent, which may be fewer than `count` once the socket
+ * buffer fills; -1 if none could be sent yet; -2 on error.
+ */
+int64_t sf_udp_send_many(int64_t fd, const char *arena, const int64_t *table, int64_t count,
+                         const char *host, int64_t port) {
+    if (fd < 0 || arena == NULL || table == NULL || count <= 0) return -2;
+
+    struct sockaddr_in addr;
+    if (udp_dest(host, port, &addr) != 0) return -2;
+
+    int64_t sent = 0;
+#if defined(__linux__)
+    struct mmsghdr msgs[SF_UDP_BATCH];
+    struct iovec iovs[SF_UDP_BATCH];
+    while (sent < count) {
+        int want = (int)(count - sent < SF_UDP_BATCH ? count - sent : SF_UDP_BATCH);
+        memset(msgs, 0, sizeof(struct mmsghdr) * (size_t)want);
+        for (int i = 0; i < want; i++) {
+            const int64_t *row = table + (sent + i) * 2;
+            iovs[i].iov_base = (void *)(arena + row[0]);
+            iovs[i].iov_len = (size_t)row[1];
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+        }
+        int n = sendmmsg((int)fd, msgs, (unsigned int)want, MSG_DONTWAIT);
+        if (n < 0) break;
+        sent += n;
+        if (n < want) break;   /* the send buffer is full */
+    }
+#else
+    while (sent < count) {
+        const int64_t *row = table + sent * 2;
+        ssize_t n = sendto((int)fd, arena + row[0], (size_t)row[1], 0,
+                           (struct sockaddr *)&addr, sizeof(addr));
+        if (n < 0) break;
+        sent++;
+    }
+#endif
+    if (sent > 0) return sent;
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ENOBUFS) return -1;
+    return -2;
+}
+
+/*
+ * Word `i` of a batch table, and its store. The tables are plain C int64
+ * arrays; these keep the Saffron side from loading raw words as Ints.
+ */
+int64_t sf_udp_table_get(const int64_t *table, int64_t i) {
+    return table ? table[i] : 0;
+}
+
+void sf_udp_table_set(int64_t *table, int64_t i, int64_t v) {
+    if (table) table[i] = v;
+}
+
 /*
  * Close a UDP socket.
  */
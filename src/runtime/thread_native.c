@@ -9,9 +9,9 @@
  *
  * ── Why a GRL, in one paragraph ────────────────────────────────────────────
  * The garbage collector is a set of process-global LLVM globals with no locking
- * (src/runtime/gc.ll): one free-list head, one shadow stack, byte counters, and
- * @__gc_alloc triggers an inline mark-sweep. Two OS threads allocating at once is
- * routine heap corruption, not a rare race. So v1 runs only ONE thread of managed
+ * (src/runtime/gc.ll): one free-list head, byte counters, the running thread's
+ * shadow stack, and @__gc_alloc triggers an inline mark-sweep. Two OS threads
+ * allocating at once is routine heap corruption, not a rare race. So v1 runs only ONE thread of managed
  * (heap-touching) Saffron code at a time, serialized by the GRL. The lock is held
  * for the whole body of every thread and released ONLY around a blocking native
  * call (join, sleep, and later mutex/condvar waits). This buys blocking-FFI/IO
@@ -33,6 +33,12 @@
 #include <time.h>
 #include <pthread.h>
 
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#define SF_RING_FUTEX 1
+#endif
+
 /* ===== The Global Runtime Lock ===== */
 
 /*
@@ -53,12 +59,37 @@ static void sf_grl_init(void) {
     pthread_mutexattr_destroy(&attr);
 }
 
+/*
+ * Each thread has its own GC shadow stack (src/runtime/gc.ll, "Per-thread Root
+ * Switching"), and the GC's globals hold the roots of whichever thread holds
+ * the GRL. The outermost lock installs this thread's roots and the matching
+ * unlock parks them, so a thread blocked with the GRL dropped keeps its roots
+ * exactly as they were and the collector, running on the holder, still marks
+ * them. Nested (recursive) lock/unlock pairs leave the roots alone.
+ */
+int64_t __gc_thread_detach(void);
+void __gc_thread_attach(int64_t roots);
+void __gc_thread_exit(void);
+
+static __thread int64_t sf_gc_roots;   /* this thread's parked roots, 0 = none */
+static __thread int sf_grl_depth;
+
 void sf_grl_lock(void) {
     pthread_once(&sf_grl_once, sf_grl_init);
     pthread_mutex_lock(&sf_grl);
+    if (sf_grl_depth++ == 0) __gc_thread_attach(sf_gc_roots);
 }
 
 void sf_grl_unlock(void) {
+    if (--sf_grl_depth == 0) sf_gc_roots = __gc_thread_detach();
+    pthread_mutex_unlock(&sf_grl);
+}
+
+/* A worker's final release: drop its roots for good instead of parking them. */
+static void sf_grl_exit(void) {
+    sf_grl_depth = 0;
+    sf_gc_roots = 0;
+    __gc_thread_exit();
     pthread_mutex_unlock(&sf_grl);
 }
 
@@ -158,7 +189,7 @@ static void *sf_thread_trampoline(void *arg) {
 
     sf_grl_lock();                                     /* enter managed code */
     int64_t r = fn(env);
-    sf_grl_unlock();                                   /* leave managed code */
+    sf_grl_exit();                                     /* leave managed code */
 
     /* Publish result/done under the table lock. A detached thread frees its own
      * slot here since no one will join it. */
@@ -291,6 +322,15 @@ void sf_thread_sleep(double seconds) {
     sf_grl_lock();
 }
 
+/*
+ * sf_thread_cpu_count — Online processor count, the default size of a
+ * Thread.Pool. Never less than 1, even if sysconf cannot tell.
+ */
+int64_t sf_thread_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int64_t)n : 1;
+}
+
 /* ===== Mutex (Workstream B) ===== */
 
 /*
@@ -389,95 +429,293 @@ void sf_mutex_free(int64_t handle) {
     pthread_mutex_unlock(&mutex_table_lock);
 }
 
-/* ===== Atomic integer (Workstream B) ===== */
+/* ===== Futex locks: Mutex, Condvar, RwLock ===== */
 
 /*
- * A single 64-bit integer with atomic operations, for lock-free counters and
- * flags shared across threads. The value lives OFF-GC (in this table), not in a
- * Saffron object field, precisely because atomics are used while the GRL is
- * dropped — a thread mid-blocking-section must be able to touch the counter
- * without touching the managed heap. The Saffron side passes and receives the
- * untagged 48-bit payload of a NaN-boxed Int and re-tags on the way out.
+ * Thread.Mutex, Thread.Condvar and Thread.RwLock keep their state in a small
+ * malloc'd cell (the same kind Thread.Atomic uses: the nursery moves managed
+ * objects, and a word someone is parked on must not move). There is no handle
+ * table. Each lock/unlock that does not contend is a single inline cmpxchg or
+ * atomicrmw in the Saffron method, so it never calls in here at all. These
+ * functions are the slow paths only. They drop the GRL, spin for a while, then
+ * park on the word.
+ *
+ * Cells are int64_t words, and every atomic here is 64-bit to match the inline
+ * atomic_*64 intrinsics. futex(2) compares 32 bits, and on the little-endian
+ * targets we build for those are the low half. Lock states stay far below
+ * 2^32, so that is the whole value. Condvar sequence numbers wrap in the low
+ * half, which only costs an extra spurious wakeup every 2^32 notifies.
+ *
+ * Mutex cell, 16 bytes:
+ *   [0] state: 0 unlocked, 1 locked, 2 locked and someone may be parked
+ *   [1] spin estimate: how long acquirers recently spun before winning
+ * This is the three-state futex mutex from Drepper's "Futexes Are Tricky".
+ * The inline fast paths are cas(0 -> 1) to lock and add(-1) to unlock; if
+ * unlock sees a nonzero result the old state was 2, and sf_lock_wake hands off.
+ *
+ * Spinning is adaptive, in the same way glibc's PTHREAD_MUTEX_ADAPTIVE_NP is.
+ * The cap is twice the lock's running estimate plus a little. A win moves the
+ * estimate an eighth of the way toward the spin count it took, and a loss moves
+ * it toward the cap. So a lock whose holders finish quickly learns to spin, and
+ * one held across a sleep or a join learns to park at once. All spinning
+ * happens with the GRL dropped. While we held it, the owner could not get back
+ * into managed code to unlock.
+ *
+ * Linux parks on the word itself. Elsewhere a small table of mutex/condvar
+ * buckets, hashed by address, stands in for the kernel's futex hash. A waiter
+ * re-checks the word under its bucket lock and a waker broadcasts under it, so
+ * no wakeup is lost. Sharing a bucket only causes spurious returns, and every
+ * caller loops on those.
  */
 
-#define SF_MAX_ATOMICS 256
+#define SF_SPIN_MAX 1000
+
+static inline void sf_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+#if !defined(__linux__)
+#define SF_PARK_BUCKETS 64
 
-/* The value is a plain int64_t, not _Atomic: the GCC/Clang __atomic_* builtins
- * used below operate on ordinary integer lvalues and reject an _Atomic-qualified
- * pointer. Atomicity comes from the builtins' memory-order argument, not the
- * type. */
 typedef struct {
-    int in_use;
-    int64_t value;
-} sf_atomic_entry_t;
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+} sf_park_bucket_t;
 
-static sf_atomic_entry_t atomic_table[SF_MAX_ATOMICS];
-static int atomic_table_initialized = 0;
-static pthread_mutex_t atomic_table_lock = PTHREAD_MUTEX_INITIALIZER;
+static sf_park_bucket_t park_buckets[SF_PARK_BUCKETS];
+static pthread_once_t park_buckets_once = PTHREAD_ONCE_INIT;
 
-int64_t sf_atomic_new(int64_t initial) {
-    int64_t h = -1;
-    pthread_mutex_lock(&atomic_table_lock);
-    if (!atomic_table_initialized) {
-        memset(atomic_table, 0, sizeof(atomic_table));
-        atomic_table_initialized = 1;
+static void park_buckets_init(void) {
+    for (int i = 0; i < SF_PARK_BUCKETS; i++) {
+        pthread_mutex_init(&park_buckets[i].mtx, NULL);
+        pthread_cond_init(&park_buckets[i].cond, NULL);
     }
-    for (int i = 0; i < SF_MAX_ATOMICS; i++) {
-        if (!atomic_table[i].in_use) {
-            atomic_table[i].in_use = 1;
-            atomic_table[i].value = initial;
-            h = i + 1;
-            break;
+}
+
+static sf_park_bucket_t *park_bucket(int64_t *word) {
+    pthread_once(&park_buckets_once, park_buckets_init);
+    return &park_buckets[((uintptr_t)word >> 4) % SF_PARK_BUCKETS];
+}
+#endif
+
+/* Sleep while *word still equals `expected`, for at most `secs` seconds
+ * (negative = no limit). Returns 0 if it timed out and 1 otherwise, which
+ * includes waking, a spurious return and finding the word already changed. */
+static int word_wait(int64_t *word, int64_t expected, double secs) {
+#if defined(__linux__)
+    struct timespec ts, *tp = NULL;
+    if (secs >= 0) {
+        ts.tv_sec = (time_t)secs;
+        ts.tv_nsec = (long)((secs - (double)ts.tv_sec) * 1e9);
+        tp = &ts;
+    }
+    long rc = syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT_PRIVATE,
+                      (uint32_t)expected, tp, NULL, 0);
+    return !(rc == -1 && errno == ETIMEDOUT);
+#else
+    sf_park_bucket_t *b = park_bucket(word);
+    int rc = 0;
+    pthread_mutex_lock(&b->mtx);
+    if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == expected) {
+        if (secs < 0) {
+            rc = pthread_cond_wait(&b->cond, &b->mtx);
+        } else {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            double end = (double)ts.tv_sec + (double)ts.tv_nsec / 1e9 + secs;
+            ts.tv_sec = (time_t)end;
+            ts.tv_nsec = (long)((end - (double)ts.tv_sec) * 1e9);
+            rc = pthread_cond_timedwait(&b->cond, &b->mtx, &ts);
         }
     }
-    pthread_mutex_unlock(&atomic_table_lock);
-    return h;
+    pthread_mutex_unlock(&b->mtx);
+    return rc != ETIMEDOUT;
+#endif
+}
+
+/* Wake up to `n` threads sleeping on *word. The caller has already changed it. */
+static void word_wake(int64_t *word, int n) {
+#if defined(__linux__)
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+#else
+    (void)n;
+    sf_park_bucket_t *b = park_bucket(word);
+    pthread_mutex_lock(&b->mtx);
+    pthread_cond_broadcast(&b->cond);
+    pthread_mutex_unlock(&b->mtx);
+#endif
+}
+
+/* Take the mutex from state 0, recording that waiters may exist. */
+static void lock_contended(int64_t *state) {
+    while (__atomic_exchange_n(state, 2, __ATOMIC_ACQUIRE) != 0)
+        word_wait(state, 2, -1);
 }
 
-static int64_t *atomic_ptr(int64_t handle) {
-    if (handle < 1 || handle > SF_MAX_ATOMICS) return NULL;
-    if (!atomic_table[handle - 1].in_use) return NULL;
-    return &atomic_table[handle - 1].value;
+/*
+ * sf_lock_wait — slow path of Mutex.lock, after the inline cas(0 -> 1) failed.
+ * Drops the GRL, spins up to the adaptive limit, then parks until handed the
+ * lock, and re-takes the GRL holding it.
+ */
+void sf_lock_wait(int64_t cell) {
+    int64_t *state = (int64_t *)cell;
+    int64_t *estimate = state + 1;
+    sf_grl_unlock();
+    int64_t est = __atomic_load_n(estimate, __ATOMIC_RELAXED);
+    int64_t limit = est * 2 + 10;
+    if (limit > SF_SPIN_MAX) limit = SF_SPIN_MAX;
+    int64_t spins = 0;
+    int won = 0;
+    while (spins < limit) {
+        int64_t expected = 0;
+        if (__atomic_load_n(state, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(state, &expected, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            won = 1;
+            break;
+        }
+        sf_cpu_relax();
+        spins++;
+    }
+    __atomic_store_n(estimate, est + (spins - est) / 8, __ATOMIC_RELAXED);
+    if (!won) lock_contended(state);
+    sf_grl_lock();
 }
 
-/* All operations are seq_cst (the default for __atomic with __ATOMIC_SEQ_CST):
- * the simplest correct memory ordering, and these are not hot enough to need a
- * weaker one. Each returns a plain int64_t the Saffron side re-tags as an Int. */
+/* Slow path of Mutex.unlock: the inline add(-1) left 1, so the state was 2.
+ * Release fully and wake one parked locker. */
+void sf_lock_wake(int64_t cell) {
+    int64_t *state = (int64_t *)cell;
+    __atomic_store_n(state, 0, __ATOMIC_RELEASE);
+    word_wake(state, 1);
+}
 
-int64_t sf_atomic_load(int64_t handle) {
-    int64_t *p = atomic_ptr(handle);
-    return p ? __atomic_load_n(p, __ATOMIC_SEQ_CST) : 0;
+static void lock_release(int64_t *state) {
+    if (__atomic_exchange_n(state, 0, __ATOMIC_RELEASE) == 2)
+        word_wake(state, 1);
 }
 
-void sf_atomic_store(int64_t handle, int64_t v) {
-    int64_t *p = atomic_ptr(handle);
-    if (p) __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+/*
+ * Condvar cell, 16 bytes:
+ *   [0] sequence, bumped by every notify
+ *   [1] waiters, so notify can skip the syscall when nobody is parked
+ *
+ * sf_cond_wait — read the sequence, release the mutex, drop the GRL, sleep
+ * until the sequence moves (or `secs` pass; negative = forever), then re-take
+ * the mutex and the GRL, in that order. A notify between the unlock and the
+ * sleep changes the sequence, so the futex compare fails and nothing is lost.
+ * The mutex is re-taken in state 2, because after a notify_all the other
+ * sleepers are about to queue on it. Returns 1 if woken, 0 on timeout.
+ */
+int64_t sf_cond_wait(int64_t cond, int64_t lock, double secs) {
+    int64_t *seq = (int64_t *)cond;
+    int64_t *waiters = seq + 1;
+    int64_t *state = (int64_t *)lock;
+    int64_t seen = __atomic_load_n(seq, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+    lock_release(state);
+    sf_grl_unlock();
+    int woke = word_wait(seq, seen, secs);
+    __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+    lock_contended(state);
+    sf_grl_lock();
+    return woke;
 }
 
-/* Add `delta` and return the NEW value (fetch-and-add + delta). */
-int64_t sf_atomic_add(int64_t handle, int64_t delta) {
-    int64_t *p = atomic_ptr(handle);
-    return p ? __atomic_add_fetch(p, delta, __ATOMIC_SEQ_CST) : 0;
+/* Wake one (n = 1) or every (n = 0) waiter. The inline notify has already
+ * bumped the sequence and seen the waiter count nonzero. */
+void sf_cond_wake(int64_t cond, int64_t n) {
+    word_wake((int64_t *)cond, n == 1 ? 1 : INT32_MAX);
 }
 
 /*
- * Compare-and-swap. If the current value equals `expected`, set it to `desired`
- * and return 1; otherwise leave it and return 0. The building block for
- * lock-free loops. Uses the strong form (no spurious failures).
+ * RwLock cell, 8 bytes, one word:
+ *   bit 0  a writer holds it
+ *   bit 1  someone may be parked
+ *   bits 2+ reader count (each reader adds 4)
+ * The inline fast paths are: a reader cas(s -> s + 4) while bits 0-1 are
+ * clear, a writer cas(0 -> 1), a reader add(-4), and a writer cas(1 -> 0).
+ * Because a parked waiter blocks new fast-path readers, a waiting writer is
+ * not starved by a stream of readers. A releaser that finds the parked bit
+ * clears it and wakes everyone. Whoever loses the race sets it again before
+ * parking, and it always parks on a value that includes the bit, so a release
+ * in between makes the futex compare fail.
  */
-int64_t sf_atomic_cas(int64_t handle, int64_t expected, int64_t desired) {
-    int64_t *p = atomic_ptr(handle);
-    if (!p) return 0;
-    return __atomic_compare_exchange_n(p, &expected, desired, 0,
-                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) ? 1 : 0;
+#define RW_WRITER  1
+#define RW_PARKED  2
+#define RW_READER  4
+
+static void rw_park(int64_t *word, int64_t seen) {
+    if ((seen & RW_PARKED) ||
+        __atomic_compare_exchange_n(word, &seen, seen | RW_PARKED, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        word_wait(word, seen | RW_PARKED, -1);
 }
 
-void sf_atomic_free(int64_t handle) {
-    pthread_mutex_lock(&atomic_table_lock);
-    if (handle >= 1 && handle <= SF_MAX_ATOMICS && atomic_table[handle - 1].in_use) {
-        atomic_table[handle - 1].in_use = 0;
+/* Slow path of RwLock.read_lock: wait out the writer (and any parked waiter,
+ * which is how writers get priority), then join the readers. */
+void sf_rw_read_wait(int64_t cell) {
+    int64_t *word = (int64_t *)cell;
+    sf_grl_unlock();
+    int64_t spins = 0;
+    for (;;) {
+        int64_t s = __atomic_load_n(word, __ATOMIC_RELAXED);
+        if ((s & (RW_WRITER | RW_PARKED)) == 0) {
+            if (__atomic_compare_exchange_n(word, &s, s + RW_READER, 0,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                break;
+            continue;
+        }
+        if (spins++ < SF_SPIN_MAX / 4) { sf_cpu_relax(); continue; }
+        rw_park(word, s);
     }
-    pthread_mutex_unlock(&atomic_table_lock);
+    sf_grl_lock();
+}
+
+/* Slow path of RwLock.write_lock: wait until there is neither a writer nor a
+ * reader. A parked bit left by others is kept, so their wakeup is not lost. */
+void sf_rw_write_wait(int64_t cell) {
+    int64_t *word = (int64_t *)cell;
+    sf_grl_unlock();
+    int64_t spins = 0;
+    for (;;) {
+        int64_t s = __atomic_load_n(word, __ATOMIC_RELAXED);
+        if ((s & ~(int64_t)RW_PARKED) == 0) {
+            if (__atomic_compare_exchange_n(word, &s, s | RW_WRITER, 0,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                break;
+            continue;
+        }
+        if (spins++ < SF_SPIN_MAX / 4) { sf_cpu_relax(); continue; }
+        rw_park(word, s);
+    }
+    sf_grl_lock();
+}
+
+/* Slow path of either unlock: the word still had the parked bit. Clear it,
+ * drop the writer bit if a writer is releasing, and wake everyone once the
+ * lock is free. */
+void sf_rw_release(int64_t cell, int64_t writer) {
+    int64_t *word = (int64_t *)cell;
+    int64_t s = __atomic_load_n(word, __ATOMIC_RELAXED);
+    for (;;) {
+        int64_t next = writer ? (s & ~(int64_t)RW_WRITER) : s;
+        if ((next & ~(int64_t)RW_PARKED) != 0) {
+            /* Readers remain; the last of them will wake the waiters. */
+            if (__atomic_compare_exchange_n(word, &s, next, 0,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+                return;
+            continue;
+        }
+        if (__atomic_compare_exchange_n(word, &s, 0, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            break;
+    }
+    word_wake(word, INT32_MAX);
 }
 
 /* ===== Channel waitset (Workstream C) ===== */
@@ -606,3 +844,274 @@ void sf_chan_ws_free(int64_t handle) {
     }
     pthread_mutex_unlock(&waitset_table_lock);
 }
+
+/* ===== Bounded MPMC ring (Workstream C) ===== */
+
+/*
+ * The sequencing half of a bounded Thread.Channel: Dmitry Vyukov's MPMC queue.
+ * Each of the `cap` cells (a power of two) carries a sequence number; a producer
+ * owns position `pos` once cell[pos & mask].seq == pos and it wins the CAS on
+ * `enq`, and a consumer owns it once seq == pos + 1 and it wins the CAS on `deq`.
+ * Neither side takes a lock, and an uncontended send or recv is one CAS plus two
+ * plain atomic accesses. The cell count is rounded up to a power of two, so a
+ * producer also checks `limit`, the capacity the channel asked for: a ring of
+ * 8 cells made for 5 still holds at most 5 items.
+ *
+ * The PAYLOAD is not here. Values are NaN-boxed and may be GC pointers, and the
+ * collector cannot see C memory, so each channel keeps a managed slot List of
+ * the same capacity and the Saffron side stores into slot `pos & mask` between
+ * claim and commit. Claim, store and commit happen without dropping the GRL, so
+ * the slot write is covered by it just as Channel's old List buffer was; the
+ * sequence numbers are what stay correct once the GRL is gone.
+ *
+ * Parking happens only at the edges: a receiver that finds the ring empty (or a
+ * sender that finds it full) bumps a waiter count, re-checks, and sleeps on an
+ * epoch word. Commits wake sleepers only when that count is non-zero, so a busy
+ * channel makes no syscalls. Linux sleeps on the word with futex(2); elsewhere
+ * a per-ring mutex and condvar stand in for it. The waiter count is incremented
+ * before the re-check and the waker reads it after publishing the seq, both
+ * seq_cst, so one of the two always sees the other: no lost wakeups.
+ */
+
+#define SF_MAX_RINGS 256
+
+typedef struct {
+    int in_use;
+    int64_t mask;
+    int64_t limit;             /* most items held at once, <= mask + 1 */
+    int64_t *seq;              /* mask + 1 cells, accessed with __atomic builtins */
+    int64_t enq;               /* next position to claim for send */
+    int64_t deq;               /* next position to claim for recv */
+    int closed;
+    uint32_t readable_epoch;   /* futex words, bumped on every wake */
+    uint32_t writable_epoch;
+    int64_t recv_waiters;
+    int64_t send_waiters;
+#if !SF_RING_FUTEX
+    pthread_mutex_t park_mtx;
+    pthread_cond_t park_cond;
+#endif
+} sf_ring_t;
+
+static sf_ring_t ring_table[SF_MAX_RINGS];
+static pthread_mutex_t ring_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static sf_ring_t *ring_ptr(int64_t handle) {
+    if (handle < 1 || handle > SF_MAX_RINGS) return NULL;
+    if (!ring_table[handle - 1].in_use) return NULL;
+    return &ring_table[handle - 1];
+}
+
+/* Create a ring holding at most `cap` items, in a power-of-two number of cells
+ * (at least two). Returns a 1-based handle, or -1 if the table is full or
+ * memory ran out. */
+int64_t sf_ring_new(int64_t cap) {
+    int64_t n = 2;
+    while (n < cap) n <<= 1;
+    int64_t *seq = malloc((size_t)n * sizeof(int64_t));
+    if (!seq) return -1;
+    for (int64_t i = 0; i < n; i++) seq[i] = i;
+
+    int64_t h = -1;
+    pthread_mutex_lock(&ring_table_lock);
+    for (int i = 0; i < SF_MAX_RINGS; i++) {
+        if (!ring_table[i].in_use) {
+            sf_ring_t *r = &ring_table[i];
+            memset(r, 0, sizeof(*r));
+            r->mask = n - 1;
+            r->limit = cap > 0 ? cap : 1;
+            r->seq = seq;
+#if !SF_RING_FUTEX
+            pthread_mutex_init(&r->park_mtx, NULL);
+            pthread_cond_init(&r->park_cond, NULL);
+#endif
+            r->in_use = 1;
+            h = i + 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ring_table_lock);
+    if (h < 0) free(seq);
+    return h;
+}
+
+/* The rounded-up cell count, so the Saffron side can size its slot List. */
+int64_t sf_ring_capacity(int64_t handle) {
+    sf_ring_t *r = ring_ptr(handle);
+    return r ? r->mask + 1 : 0;
+}
+
+/* Items committed or in flight: enq - deq, clamped at 0. Exact while the
+ * caller holds the GRL, a hint otherwise. */
+int64_t sf_ring_length(int64_t handle) {
+    sf_ring_t *r = ring_ptr(handle);
+    if (!r) return 0;
+    int64_t n = __atomic_load_n(&r->enq, __ATOMIC_SEQ_CST)
+              - __atomic_load_n(&r->deq, __ATOMIC_SEQ_CST);
+    return n > 0 ? n : 0;
+}
+
+/* Claim the next send position, or -1 if the ring is full (or holds `limit`
+ * items). The caller stores its value in slot (pos & mask) and then calls
+ * sf_ring_commit_send(pos). deq only grows, so a stale read of it can only make
+ * the ring look fuller than it is, never let it pass `limit`. */
+int64_t sf_ring_claim_send(int64_t handle) {
+    sf_ring_t *r = ring_ptr(handle);
+    if (!r) return -1;
+    int64_t pos = __atomic_load_n(&r->enq, __ATOMIC_RELAXED);
+    for (;;) {
+        int64_t seq = __atomic_load_n(&r->seq[pos & r->mask], __ATOMIC_ACQUIRE);
+        int64_t dif = seq - pos;
+        if (dif == 0) {
+            if (pos - __atomic_load_n(&r->deq, __ATOMIC_ACQUIRE) >= r->limit)
+                return -1;             /* at capacity, cells to spare or not */
+            if (__atomic_compare_exchange_n(&r->enq, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                return pos;
+        } else if (dif < 0) {
+            return -1;                 /* the cell still holds an unread value */
+        } else {
+            pos = __atomic_load_n(&r->enq, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* Publish a claimed send position to receivers. Does not wake anyone; see
+ * sf_ring_wake_recv, which a batch send calls once at the end. */
+void sf_ring_commit_send(int64_t handle, int64_t pos) {
+    sf_ring_t *r = ring_ptr(handle);
+    if (r) __atomic_store_n(&r->seq[pos & r->mask], pos + 1, __ATOMIC_RELEASE);
+}
+
+/* Claim the next receive position, or -1 if the ring is empty. */
+int64_t sf_ring_claim_recv(int64_t handle) {
+    sf_ring_t *r = ring_ptr(handle);
+    if (!r) return -1;
+    int64_t pos = __atomic_load_n(&r->deq, __ATOMIC_RELAXED);
+    for (;;) {
+        int64_t seq = __atomic_load_n(&r->seq[pos & r->mask], __ATOMIC_ACQUIRE);
+        int64_t dif = seq - (pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&r->deq, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                return pos;
+        } else if (dif < 0) {
+            return -1;                 /* nothing published at this position */
+        } else {
+            pos = __atomic_load_n(&r->deq, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* Hand a consumed cell back to producers, one lap ahead. */
+void sf_ring_commit_recv(int64_t handle, int64_t pos) {
+    sf_ring_t *r = ring_ptr(handle);
+    if (r) __atomic_store_n(&r->seq[pos & r->mask], pos + r->mask + 1, __ATOMIC_RELEASE);
+}
+
+static int ring_readable(sf_ring_t *r) {
+    int64_t pos = __atomic_load_n(&r->deq, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&r->seq[pos & r->mask], __ATOMIC_SEQ_CST) == pos + 1;
+}
+
+static int ring_writable(sf_ring_t *r) {
+    int64_t pos = __atomic_load_n(&r->enq, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&r->seq[pos & r->mask], __ATOMIC_SEQ_CST) == pos
+        && pos - __atomic_load_n(&r->deq, __ATOMIC_SEQ_CST) < r->limit;
+}
+
+static void ring_park(sf_ring_t *r, uint32_t *word, uint32_t seen) {
+#if SF_RING_FUTEX
+    (void)r;
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&r->park_mtx);
+    while (__atomic_load_n(word, __ATOMIC_SEQ_CST) == seen)
+        pthread_cond_wait(&r->park_cond, &r->park_mtx);
+    pthread_mutex_unlock(&r->park_mtx);
+#endif
+}
+
+static void ring_unpark(sf_ring_t *r, uint32_t *word) {
+#if SF_RING_FUTEX
+    (void)r;
+    __atomic_add_fetch(word, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&r->park_mtx);
+    __atomic_add_fetch(word, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&r->park_cond);
+    pthread_mutex_unlock(&r->park_mtx);
+#endif
+}
+
+/*
+ * Block until the ring is readable or closed. Caller holds the GRL and has just
+ * seen sf_ring_claim_recv fail; it retries the claim after this returns, so a
+ * spurious return just loops. The GRL is dropped only around the park itself.
+ */
+void sf_ring_wait_recv(int64_t handle) {
+    sf_ring_t *r = ring_ptr(handle);
+    if (!r) return;
+    uint32_t seen = __atomic_load_n(&r->readable_epoch, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&r->recv_waiters, 1, __ATOMIC_SEQ_CST);
+    if (!ring_readable(r) && !__atomic_load_n(&r->closed, __ATOMIC_SEQ_CST)) {
+        sf_grl_unlock();
+        ring_park(r, &r->readable_epoch, seen);
+        sf_grl_lock();
+    }
+    __atomic_sub_fetch(&r->recv_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Block until the ring has a free cell or is closed. Same protocol. */
+void sf_ring_wait_send(int64_t handle) {
+    sf_ring_t *r = ring_ptr(handle);
+    if (!r) return;
+    uint32_t seen = __atomic_load_n(&r->writable_epoch, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&r->send_waiters, 1, __ATOMIC_SEQ_CST);
+    if (!ring_writable(r) && !__atomic_load_n(&r->closed, __ATOMIC_SEQ_CST)) {
+        sf_grl_unlock();
+        ring_park(r, &r->writable_epoch, seen);
+        sf_grl_lock();
+    }
+    __atomic_sub_fetch(&r->send_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Wake parked receivers after one or more commits — a no-op unless one is
+ * parked, which is what keeps a busy channel out of the kernel. */
+void sf_ring_wake_recv(int64_t handle) {
+    sf_ring_t *r = ring_ptr(handle);
+    if (r && __atomic_load_n(&r->recv_waiters, __ATOMIC_SEQ_CST) > 0)
+        ring_unpark(r, &r->readable_epoch);
+}
+
+/* Wake parked senders after one or more receives. */
+void sf_ring_wake_send(int64_t handle) {
+    sf_ring_t *r = ring_ptr(handle);
+    if (r && __atomic_load_n(&r->send_waiters, __ATOMIC_SEQ_CST) > 0)
+        ring_unpark(r, &r->writable_epoch);
+}
+
+/* Mark the ring closed and release every parked sender and receiver. */
+void sf_ring_close(int64_t handle) {
+    sf_ring_t *r = ring_ptr(handle);
+    if (!r) return;
+    __atomic_store_n(&r->closed, 1, __ATOMIC_SEQ_CST);
+    ring_unpark(r, &r->readable_epoch);
+    ring_unpark(r, &r->writable_epoch);
+}
+
+void sf_ring_free(int64_t handle) {
+    pthread_mutex_lock(&ring_table_lock);
+    sf_ring_t *r = ring_ptr(handle);
+    if (r) {
+        free(r->seq);
+        r->seq = NULL;
+#if !SF_RING_FUTEX
+        pthread_cond_destroy(&r->park_cond);
+        pthread_mutex_destroy(&r->park_mtx);
+#endif
+        r->in_use = 0;
+    }
+    pthread_mutex_unlock(&ring_table_lock);
+}
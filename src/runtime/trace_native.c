@@ -0,0 +1,398 @@
+/*
+ * Saffron Runtime: Trace Events
+ * =============================
+ *
+ * Timeline tracing for src/lib/trace.sf. Two kinds of event are recorded:
+ *
+ *   task slices  scheduler_tick() reports every resume and the suspend that
+ *                ends it. Each becomes one complete ("X") event on the track of
+ *                the thread that ran it, named after the task's entry function
+ *                and tagged with what it suspended on.
+ *   spans        Trace.span / Trace.begin / Trace.end in Saffron code. They go
+ *                on the track of the task they run in (or of the thread, outside
+ *                any task), so a span left open across a suspend shows the whole
+ *                wait: one request handled by one task reads end to end.
+ *
+ * SAFFRON_TRACE=<path> starts recording at startup; the trace is written to
+ * <path> at exit, and again whenever the process gets SIGUSR1 (the handler only
+ * raises a flag; the file is written at the next task switch or span end, on a
+ * thread that may use stdio). Trace.start(path) does the same from code.
+ *
+ * The output is Chrome trace_event JSON, which chrome://tracing, Perfetto's UI
+ * (ui.perfetto.dev) and speedscope all open directly.
+ *
+ * ── Buffers ────────────────────────────────────────────────────────────────
+ * Each thread records into its own ring of SAFFRON_TRACE_EVENTS fixed-size
+ * events (default 65536), so recording takes no lock and never allocates after
+ * the first event. When a ring is full the oldest events are overwritten: a
+ * long run keeps its most recent stretch. Rings are pushed onto a global list
+ * with a CAS on first use and live until exit, so a thread that has finished is
+ * still in the trace.
+ *
+ * The writer publishes an event by storing the ring's head with release order.
+ * A flush reads the head, copies what is in the ring, reads the head again and
+ * drops any event the writer may have overwritten meanwhile, so it is safe
+ * against a thread still recording (which the GRL mostly rules out anyway).
+ */
+
+/* Dl_info / dladdr are GNU extensions in glibc's <dlfcn.h>. */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#define TR_NAME 32
+#define TR_DETAIL 59
+#define TR_DEFAULT_EVENTS 65536
+/* Task tracks are numbered after every possible thread track. */
+#define TR_TASK_TID_BASE 100000
+
+typedef struct {
+    int64_t ts_ns;
+    int64_t dur_ns;           /* 'X' only */
+    int64_t task;             /* the task it happened in; 0 = none */
+    void *entry;              /* 'X': the task's resume function */
+    int32_t reason;           /* 'X': yield reason it suspended with, -1 = done */
+    char ph;                  /* 'B', 'E' or 'X' */
+    char name[TR_NAME];
+    char detail[TR_DETAIL];
+} tr_event;
+
+typedef struct tr_ring {
+    struct tr_ring *next;
+    _Atomic int64_t head;     /* events ever written; slot = head % cap */
+    int64_t tid;
+    tr_event *events;
+} tr_ring;
+
+static _Atomic(tr_ring *) tr_rings = NULL;
+static _Atomic int64_t tr_next_tid = 1;
+static int64_t tr_cap = TR_DEFAULT_EVENTS;
+static int tr_on = 0;
+static char *tr_path = NULL;
+static volatile sig_atomic_t tr_flush_requested = 0;
+
+static _Thread_local tr_ring *tr_mine = NULL;
+/* The task this thread is running, and when its slice began. */
+static _Thread_local int64_t tr_task = 0;
+static _Thread_local int64_t tr_task_start = 0;
+static _Thread_local void *tr_task_entry = NULL;
+
+static int64_t tr_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static tr_ring *tr_ring_get(void) {
+    if (tr_mine) return tr_mine;
+    tr_ring *r = calloc(1, sizeof(tr_ring));
+    if (!r) return NULL;
+    r->events = calloc((size_t)tr_cap, sizeof(tr_event));
+    if (!r->events) {
+        free(r);
+        return NULL;
+    }
+    r->tid = atomic_fetch_add(&tr_next_tid, 1);
+    tr_ring *old = atomic_load(&tr_rings);
+    do {
+        r->next = old;
+    } while (!atomic_compare_exchange_weak(&tr_rings, &old, r));
+    tr_mine = r;
+    return r;
+}
+
+/* The next slot to fill; published by tr_publish(). NULL if out of memory. */
+static tr_event *tr_slot(tr_ring **out) {
+    tr_ring *r = tr_ring_get();
+    if (!r) return NULL;
+    *out = r;
+    int64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    return &r->events[h % tr_cap];
+}
+
+static void tr_publish(tr_ring *r) {
+    int64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+static void tr_copy(char *dst, size_t n, const char *src) {
+    if (!src) src = "";
+    size_t len = strlen(src);
+    if (len >= n) len = n - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+/* ===== Output ===== */
+
+static void tr_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (const unsigned char *c = (const unsigned char *)s; *c; c++) {
+        if (*c == '"' || *c == '\\') fprintf(f, "\\%c", *c);
+        else if (*c < 0x20) fprintf(f, "\\u%04x", *c);
+        else fputc(*c, f);
+    }
+    fputc('"', f);
+}
+
+static void tr_entry_name(char *buf, size_t n, void *entry) {
+    Dl_info info;
+    if (entry && dladdr(entry, &info) && info.dli_sname && info.dli_saddr == entry) {
+        snprintf(buf, n, "%s", info.dli_sname);
+    } else {
+        snprintf(buf, n, "task@%llx", (unsigned long long)(uintptr_t)entry);
+    }
+}
+
+static const char *tr_reason_name(int32_t reason) {
+    static const char *names[] = {
+        "yield", "sleep", "read", "await", "write", "actor", "io", "uring", "offload",
+        "park"
+    };
+    if (reason < 0) return "done";
+    if (reason < 10) return names[reason];
+    return "?";
+}
+
+/*
+ * Task tracks: handle -> track id and entry function, built while writing.
+ * Open addressing over a table sized to twice the events there can be, so it
+ * never fills.
+ */
+typedef struct {
+    int64_t handle;
+    int64_t tid;
+    void *entry;
+} tr_track;
+
+static tr_track *tr_tracks;
+static int64_t tr_track_cap, tr_track_count;
+
+static tr_track *tr_track_for(int64_t handle) {
+    uint64_t h = (uint64_t)handle * 0x9E3779B97F4A7C15ULL;
+    int64_t i = (int64_t)(h >> 20) & (tr_track_cap - 1);
+    while (tr_tracks[i].handle && tr_tracks[i].handle != handle) {
+        i = (i + 1) & (tr_track_cap - 1);
+    }
+    if (!tr_tracks[i].handle) {
+        tr_tracks[i].handle = handle;
+        tr_tracks[i].tid = TR_TASK_TID_BASE + ++tr_track_count;
+    }
+    return &tr_tracks[i];
+}
+
+static void tr_write_event(FILE *f, const tr_event *e, int64_t thread_tid, int *first) {
+    char name[256];
+    int64_t tid = thread_tid;
+    if (e->ph == 'X') {
+        tr_track *t = tr_track_for(e->task);
+        if (!t->entry) t->entry = e->entry;
+        tr_entry_name(name, sizeof(name), e->entry);
+    } else {
+        if (e->task) tid = tr_track_for(e->task)->tid;
+        snprintf(name, sizeof(name), "%s", e->name);
+    }
+    fputs(*first ? "\n" : ",\n", f);
+    *first = 0;
+    fprintf(f, "{\"ph\":\"%c\",\"pid\":1,\"tid\":%lld,\"ts\":%.3f", e->ph,
+            (long long)tid, (double)e->ts_ns / 1000.0);
+    if (e->ph != 'E') {
+        fputs(",\"name\":", f);
+        tr_json_string(f, name);
+    }
+    if (e->ph == 'X') {
+        fprintf(f, ",\"dur\":%.3f,\"args\":{\"task\":%lld,\"then\":\"%s\"}",
+                (double)e->dur_ns / 1000.0,
+                (long long)(tr_track_for(e->task)->tid - TR_TASK_TID_BASE),
+                tr_reason_name(e->reason));
+    } else if (e->detail[0]) {
+        fputs(",\"args\":{\"detail\":", f);
+        tr_json_string(f, e->detail);
+        fputc('}', f);
+    }
+    fputc('}', f);
+}
+
+/* Write every ring to `path`; returns the number of events written, or -1. */
+static int64_t tr_write(const char *path) {
+    if (!path) return -1;
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    tr_event *copy = malloc((size_t)tr_cap * sizeof(tr_event));
+    int64_t rings = 0;
+    for (tr_ring *r = atomic_load(&tr_rings); r; r = r->next) rings++;
+    tr_track_cap = 1;
+    while (tr_track_cap < 2 * tr_cap * (rings ? rings : 1)) tr_track_cap <<= 1;
+    tr_tracks = calloc((size_t)tr_track_cap, sizeof(tr_track));
+    tr_track_count = 0;
+    if (!copy || !tr_tracks) {
+        free(copy);
+        free(tr_tracks);
+        tr_tracks = NULL;
+        fclose(f);
+        return -1;
+    }
+    int64_t written = 0;
+    int first = 1;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+    for (tr_ring *r = atomic_load(&tr_rings); r; r = r->next) {
+        int64_t h = atomic_load_explicit(&r->head, memory_order_acquire);
+        int64_t base = h > tr_cap ? h - tr_cap : 0;
+        for (int64_t i = base; i < h; i++) copy[i - base] = r->events[i % tr_cap];
+        /* Anything the writer lapped while we copied is not trustworthy. */
+        int64_t h2 = atomic_load_explicit(&r->head, memory_order_acquire);
+        int64_t from = h2 > tr_cap ? h2 - tr_cap : 0;
+        if (from < base) from = base;
+        for (int64_t i = from; i < h; i++) {
+            tr_write_event(f, &copy[i - base], r->tid, &first);
+            written++;
+        }
+        fputs(first ? "\n" : ",\n", f);
+        first = 0;
+        fprintf(f, "{\"ph\":\"M\",\"pid\":1,\"tid\":%lld,\"name\":\"thread_name\","
+                   "\"args\":{\"name\":\"thread %lld\"}}",
+                (long long)r->tid, (long long)r->tid);
+    }
+    for (int64_t i = 0; i < tr_track_cap; i++) {
+        tr_track *t = &tr_tracks[i];
+        if (!t->handle) continue;
+        char entry[200];
+        if (t->entry) tr_entry_name(entry, sizeof(entry), t->entry);
+        else snprintf(entry, sizeof(entry), "task");
+        fputs(first ? "\n" : ",\n", f);
+        first = 0;
+        fprintf(f, "{\"ph\":\"M\",\"pid\":1,\"tid\":%lld,\"name\":\"thread_name\",\"args\":{\"name\":",
+                (long long)t->tid);
+        char label[240];
+        snprintf(label, sizeof(label), "task %lld %s", (long long)(t->tid - TR_TASK_TID_BASE), entry);
+        tr_json_string(f, label);
+        fputs("}}", f);
+    }
+    fputs("\n]}\n", f);
+    free(copy);
+    free(tr_tracks);
+    tr_tracks = NULL;
+    return fclose(f) == 0 ? written : -1;
+}
+
+static void tr_flush_if_asked(void) {
+    if (!tr_flush_requested) return;
+    tr_flush_requested = 0;
+    tr_write(tr_path);
+}
+
+/* ===== Exports (declared in src/lib/trace.sf and src/lib/scheduler.sf) ===== */
+
+int64_t sf_trace_on(void) {
+    return tr_on;
+}
+
+/* Record from now on, writing to `path` at exit (and on flush/SIGUSR1). */
+int64_t sf_trace_start(const char *path) {
+    if (path && *path) {
+        free(tr_path);
+        tr_path = strdup(path);
+    }
+    tr_on = 1;
+    return tr_path != NULL;
+}
+
+void sf_trace_stop(void) {
+    tr_on = 0;
+}
+
+int64_t sf_trace_flush(void) {
+    tr_flush_requested = 0;
+    return tr_write(tr_path);
+}
+
+/* Open a span named `name` on the current task's (or thread's) track. */
+void sf_trace_begin(const char *name, const char *detail) {
+    if (!tr_on) return;
+    tr_ring *r;
+    tr_event *e = tr_slot(&r);
+    if (!e) return;
+    e->ts_ns = tr_now_ns();
+    e->dur_ns = 0;
+    e->task = tr_task;
+    e->entry = NULL;
+    e->reason = 0;
+    e->ph = 'B';
+    tr_copy(e->name, sizeof(e->name), name);
+    tr_copy(e->detail, sizeof(e->detail), detail);
+    tr_publish(r);
+}
+
+/* Close the innermost open span on this track; `detail` is merged into it. */
+void sf_trace_end(const char *detail) {
+    if (!tr_on) return;
+    tr_ring *r;
+    tr_event *e = tr_slot(&r);
+    if (!e) return;
+    e->ts_ns = tr_now_ns();
+    e->dur_ns = 0;
+    e->task = tr_task;
+    e->entry = NULL;
+    e->reason = 0;
+    e->ph = 'E';
+    e->name[0] = '\0';
+    tr_copy(e->detail, sizeof(e->detail), detail);
+    tr_publish(r);
+    tr_flush_if_asked();
+}
+
+/* scheduler_tick() is about to resume `handle`. */
+void sf_trace_task_resume(int64_t handle) {
+    tr_task = handle;
+    tr_task_start = tr_now_ns();
+    /* Slot 0 of a frame is its resume function, until it finishes. */
+    tr_task_entry = handle ? *(void **)(intptr_t)handle : NULL;
+}
+
+/* The resume returned: `handle` suspended with `reason`, or finished (-1). */
+void sf_trace_task_suspend(int64_t handle, int64_t reason) {
+    int64_t now = tr_now_ns();
+    tr_task = 0;
+    if (!tr_on) return;
+    tr_ring *r;
+    tr_event *e = tr_slot(&r);
+    if (!e) return;
+    e->ts_ns = tr_task_start;
+    e->dur_ns = now - tr_task_start;
+    e->task = handle;
+    e->entry = tr_task_entry;
+    e->reason = (int32_t)reason;
+    e->ph = 'X';
+    e->name[0] = '\0';
+    e->detail[0] = '\0';
+    tr_publish(r);
+    tr_flush_if_asked();
+}
+
+static void tr_on_signal(int sig) {
+    (void)sig;
+    tr_flush_requested = 1;
+}
+
+static void tr_write_at_exit(void) {
+    if (tr_path) tr_write(tr_path);
+}
+
+__attribute__((constructor)) static void tr_init(void) {
+    const char *n = getenv("SAFFRON_TRACE_EVENTS");
+    if (n && atoll(n) > 0) tr_cap = atoll(n);
+    atexit(tr_write_at_exit);
+    const char *path = getenv("SAFFRON_TRACE");
+    if (!path || !*path) return;
+    sf_trace_start(path);
+    signal(SIGUSR1, tr_on_signal);
+}
@@ -0,0 +1,499 @@
+/*
+ * Saffron Runtime: io_uring Completion Backend
+ * ============================================
+ *
+ * An optional alternative to the readiness reactor (reactor_native.c) for the
+ * operations that dominate a server: accept, recv, send, and file read/write.
+ * Instead of trying the syscall, getting EWOULDBLOCK, parking on readiness and
+ * trying again, a task queues the operation itself and suspends (yield reason
+ * 7) until the kernel posts its completion. Queuing only writes a submission
+ * entry into the shared ring; the scheduler submits everything queued during a
+ * tick, and reaps every completion, in one io_uring_enter() when it runs out of
+ * runnable tasks — no syscall per operation.
+ *
+ * Selected with SAFFRON_IO_BACKEND=uring, Linux only. Raw syscalls, no liburing.
+ * If io_uring_setup() fails (old kernel, seccomp, a container that blocks it),
+ * or the kernel lacks one of the opcodes below, the backend stays off and every
+ * sf_uring_* submit returns -1 — callers then take the readiness path exactly
+ * as if the variable were unset. On other platforms this file compiles to that
+ * fallback.
+ *
+ * ── Operations ─────────────────────────────────────────────────────────────
+ * A submit returns an op id (>= 0). The task then either suspends with
+ * __suspend(7, op) — the scheduler calls sf_uring_park(op, handle) and
+ * re-queues the task when the op completes — or calls sf_uring_result(op)
+ * directly, which blocks until completion. sf_uring_result() always frees the
+ * op; it returns what the matching sf_tcp_* call would have: bytes (or an fd
+ * for accept), 0 at EOF, -1 for "would block, retry", -2 for an error.
+ *
+ * A task destroyed while it waits never calls sf_uring_result. Destroying a
+ * frame calls sf_uring_forget(handle), which frees the task's op if it has
+ * completed, or orphans it so the harvest frees it when the kernel is done
+ * with the buffer.
+ *
+ * ── Waiting ────────────────────────────────────────────────────────────────
+ * sf_uring_wait(timeout_ms, watch_fd) is the scheduler's idle wait. The timer
+ * budget becomes an IORING_OP_TIMEOUT in the same submission, and watch_fd
+ * (the reactor's epoll fd, when tasks are parked on readiness) a one-shot
+ * IORING_OP_POLL_ADD, so one blocking call covers completions, readiness
+ * waiters and the next timer at once.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <poll.h>
+#define SF_URING 1
+#endif
+#endif
+
+#if SF_URING
+
+#define UR_ENTRIES 256
+#define UR_TAG_TIMEOUT UINT64_MAX
+#define UR_TAG_WATCH (UINT64_MAX - 1)
+
+enum { UR_FREE, UR_INFLIGHT, UR_DONE, UR_ORPHAN };
+
+typedef struct {
+    int64_t result;
+    int64_t token;           /* parked task handle, 0 = none */
+    int state;
+    int kind;                /* IORING_OP_* it was submitted as */
+    int next_free;
+} ur_op;
+
+static int ur_fd = -2;                /* -2 = not initialised, -1 = off */
+static unsigned ur_sq_mask, ur_cq_mask;
+static unsigned *ur_sq_head, *ur_sq_tail, *ur_sq_array;
+static unsigned *ur_cq_head, *ur_cq_tail;
+static struct io_uring_sqe *ur_sqes;
+static struct io_uring_cqe *ur_cqes;
+static unsigned ur_queued = 0;        /* SQEs written but not yet submitted */
+
+static ur_op *ur_ops = NULL;
+static int ur_nops = 0;
+static int ur_free_head = -1;
+static int64_t ur_inflight = 0;
+static int64_t ur_parked = 0;
+static int64_t ur_owned = 0;          /* ops with a token, parked or done */
+
+static int64_t *ur_ready = NULL;      /* tokens of parked ops that completed */
+static int ur_ready_count = 0;
+static int ur_ready_cap = 0;
+static int ur_ready_returned = 0;     /* how many the last wait handed out */
+
+static int ur_watch_armed = -1;       /* fd with a POLL_ADD outstanding */
+static struct __kernel_timespec ur_ts;
+
+static int ur_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ur_enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, ur_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/* Every opcode the backend issues must be supported, or it stays off. */
+static int ur_probe_ok(void) {
+    static const int needed[] = {
+        IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ,
+        IORING_OP_WRITE, IORING_OP_TIMEOUT, IORING_OP_POLL_ADD,
+    };
+    size_t sz = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, sz);
+    if (!probe) return 0;
+    int ok = syscall(__NR_io_uring_register, ur_fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(needed) / sizeof(needed[0]); i++) {
+        int op = needed[i];
+        ok = op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+static void ur_init(void) {
+    if (ur_fd != -2) return;
+    ur_fd = -1;
+    const char *b = getenv("SAFFRON_IO_BACKEND");
+    if (!b || strcmp(b, "uring") != 0) return;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = ur_setup(UR_ENTRIES, &p);
+    if (fd < 0) return;
+    ur_fd = fd;
+
+    size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && cq_len > sq_len) sq_len = cq_len;
+    char *sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQ_RING);
+    char *cq = sq;
+    if (sq != MAP_FAILED && !single) {
+        cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  fd, IORING_OFF_CQ_RING);
+    }
+    void *sqes = MAP_FAILED;
+    if (sq != MAP_FAILED && cq != MAP_FAILED) {
+        sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    }
+    if (sqes == MAP_FAILED || !ur_probe_ok()) {
+        close(fd);           /* the mappings die with the process; this is startup */
+        ur_fd = -1;
+        return;
+    }
+    ur_sq_head = (unsigned *)(sq + p.sq_off.head);
+    ur_sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ur_sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    ur_sq_array = (unsigned *)(sq + p.sq_off.array);
+    ur_cq_head = (unsigned *)(cq + p.cq_off.head);
+    ur_cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ur_cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    ur_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ur_sqes = sqes;
+}
+
+/* ===== Ops table ===== */
+
+static int ur_op_alloc(int kind) {
+    if (ur_free_head < 0) {
+        int n = ur_nops ? ur_nops * 2 : 64;
+        ur_op *grown = realloc(ur_ops, (size_t)n * sizeof(ur_op));
+        if (!grown) return -1;
+        for (int i = ur_nops; i < n; i++) {
+            grown[i].state = UR_FREE;
+            grown[i].next_free = i + 1 < n ? i + 1 : -1;
+        }
+        ur_free_head = ur_nops;
+        ur_ops = grown;
+        ur_nops = n;
+    }
+    int id = ur_free_head;
+    ur_free_head = ur_ops[id].next_free;
+    ur_ops[id].state = UR_INFLIGHT;
+    ur_ops[id].kind = kind;
+    ur_ops[id].token = 0;
+    ur_ops[id].result = 0;
+    ur_inflight++;
+    return id;
+}
+
+static void ur_op_free(int id) {
+    if (ur_ops[id].token != 0) ur_owned--;
+    ur_ops[id].token = 0;
+    ur_ops[id].state = UR_FREE;
+    ur_ops[id].next_free = ur_free_head;
+    ur_free_head = id;
+}
+
+static void ur_push_ready(int64_t token) {
+    if (ur_ready_count == ur_ready_cap) {
+        int n = ur_ready_cap ? ur_ready_cap * 2 : 64;
+        int64_t *grown = realloc(ur_ready, (size_t)n * sizeof(int64_t));
+        if (!grown) return;
+        ur_ready = grown;
+        ur_ready_cap = n;
+    }
+    ur_ready[ur_ready_count++] = token;
+}
+
+/* ===== Ring access ===== */
+
+/* Submit what is queued without waiting; makes room when the SQ is full. */
+static void ur_flush(void) {
+    while (ur_queued > 0) {
+        int rc = ur_enter(ur_queued, 0, 0);
+        if (rc <= 0) return;             /* EINTR/EBUSY: the next wait retries */
+        ur_queued -= (unsigned)rc;
+    }
+}
+
+static struct io_uring_sqe *ur_sqe(void) {
+    unsigned tail = *ur_sq_tail;
+    if (tail - __atomic_load_n(ur_sq_head, __ATOMIC_ACQUIRE) > ur_sq_mask) {
+        ur_flush();
+        if (tail - __atomic_load_n(ur_sq_head, __ATOMIC_ACQUIRE) > ur_sq_mask) return NULL;
+    }
+    unsigned idx = tail & ur_sq_mask;
+    struct io_uring_sqe *sqe = &ur_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ur_sq_array[idx] = idx;
+    return sqe;
+}
+
+static void ur_commit(void) {
+    __atomic_store_n(ur_sq_tail, *ur_sq_tail + 1, __ATOMIC_RELEASE);
+    ur_queued++;
+}
+
+/* Reap every posted completion. */
+static void ur_harvest(void) {
+    unsigned head = *ur_cq_head;
+    unsigned tail = __atomic_load_n(ur_cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &ur_cqes[head & ur_cq_mask];
+        uint64_t tag = cqe->user_data;
+        if (tag == UR_TAG_WATCH) {
+            ur_watch_armed = -1;
+        } else if (tag != UR_TAG_TIMEOUT && tag < (uint64_t)ur_nops) {
+            ur_op *op = &ur_ops[tag];
+            if (op->state == UR_ORPHAN) {
+                ur_inflight--;
+                ur_op_free((int)tag);
+            } else if (op->state == UR_INFLIGHT) {
+                op->state = UR_DONE;
+                op->result = cqe->res;
+                ur_inflight--;
+                if (op->token != 0) {
+                    ur_push_ready(op->token);
+                    ur_parked--;
+                }
+            }
+        }
+        head++;
+    }
+    __atomic_store_n(ur_cq_head, head, __ATOMIC_RELEASE);
+}
+
+static int ur_cq_empty(void) {
+    return *ur_cq_head == __atomic_load_n(ur_cq_tail, __ATOMIC_ACQUIRE);
+}
+
+static int64_t ur_submit(int kind, int64_t fd, void *buf, int64_t len, uint64_t off, int flags) {
+    ur_init();
+    if (ur_fd < 0 || fd < 0) return -1;
+    struct io_uring_sqe *sqe = ur_sqe();
+    if (!sqe) return -1;
+    int id = ur_op_alloc(kind);
+    if (id < 0) return -1;
+    sqe->opcode = (uint8_t)kind;
+    sqe->fd = (int)fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (unsigned)len;
+    sqe->off = off;
+    if (kind == IORING_OP_ACCEPT) sqe->accept_flags = (unsigned)flags;
+    else if (kind == IORING_OP_RECV || kind == IORING_OP_SEND) sqe->msg_flags = (unsigned)flags;
+    sqe->user_data = (uint64_t)id;
+    ur_commit();
+    return id;
+}
+
+/* ===== Exports ===== */
+
+/* sf_uring_enabled — 1 when SAFFRON_IO_BACKEND=uring took effect. */
+int64_t sf_uring_enabled(void) {
+    ur_init();
+    return ur_fd >= 0;
+}
+
+/* Submits (declared in src/lib/net.sf and src/lib/io.sf). -1 = use readiness. */
+
+int64_t sf_uring_accept(int64_t fd) {
+    return ur_submit(IORING_OP_ACCEPT, fd, NULL, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+int64_t sf_uring_recv(int64_t fd, char *buf, int64_t len) {
+    if (!buf || len <= 0) return -1;
+    return ur_submit(IORING_OP_RECV, fd, buf, len, 0, 0);
+}
+
+int64_t sf_uring_send(int64_t fd, const char *buf, int64_t len) {
+    if (!buf || len <= 0) return -1;
+    return ur_submit(IORING_OP_SEND, fd, (void *)buf, len, 0, MSG_NOSIGNAL);
+}
+
+int64_t sf_uring_read(int64_t fd, char *buf, int64_t len, int64_t offset) {
+    if (!buf || len <= 0 || offset < 0) return -1;
+    return ur_submit(IORING_OP_READ, fd, buf, len, (uint64_t)offset, 0);
+}
+
+int64_t sf_uring_write(int64_t fd, const char *buf, int64_t len, int64_t offset) {
+    if (!buf || len <= 0 || offset < 0) return -1;
+    return ur_submit(IORING_OP_WRITE, fd, (void *)buf, len, (uint64_t)offset, 0);
+}
+
+/*
+ * sf_uring_result — The outcome of `op`, blocking (submitting and reaping)
+ * until it completes, then free the op. Mapped onto the sf_tcp_* convention.
+ */
+int64_t sf_uring_result(int64_t op) {
+    if (ur_fd < 0 || op < 0 || op >= ur_nops || ur_ops[op].state == UR_FREE) return -2;
+    while (ur_ops[op].state == UR_INFLIGHT) {
+        ur_harvest();
+        if (ur_ops[op].state != UR_INFLIGHT) break;
+        int rc = ur_enter(ur_queued, 1, IORING_ENTER_GETEVENTS);
+        if (rc >= 0) ur_queued -= (unsigned)rc;
+        else if (errno != EINTR && errno != EBUSY && errno != EAGAIN) return -2;
+    }
+    int64_t res = ur_ops[op].result;
+    ur_op_free((int)op);
+    if (res >= 0) return res;
+    if (res == -EAGAIN || res == -EWOULDBLOCK || res == -EINTR) return -1;
+    return -2;
+}
+
+/*
+ * sf_uring_park — Task `token` waits on `op`. Returns 1 when the op has
+ * already completed (resume it now), 0 when parked until sf_uring_wait()
+ * reports it.
+ */
+int64_t sf_uring_park(int64_t op, int64_t token) {
+    if (ur_fd < 0 || op < 0 || op >= ur_nops || ur_ops[op].state != UR_INFLIGHT) return 1;
+    ur_ops[op].token = token;
+    ur_parked++;
+    ur_owned++;
+    return 0;
+}
+
+/* Drop `token` from the ready list, so a destroyed task is never resumed. */
+static void ur_unready(int64_t token) {
+    int k = 0;
+    for (int i = 0; i < ur_ready_count; i++) {
+        if (ur_ready[i] == token) {
+            if (i < ur_ready_returned) ur_ready_returned--;
+            continue;
+        }
+        ur_ready[k++] = ur_ready[i];
+    }
+    ur_ready_count = k;
+}
+
+/*
+ * sf_uring_forget — Task `token` is being destroyed. Free its completed op, or
+ * orphan an op still in flight: the kernel may yet write into its buffer, so
+ * the slot is only reused once the completion has been reaped.
+ */
+void sf_uring_forget(int64_t token) {
+    if (ur_owned == 0 || token == 0) return;
+    for (int i = 0; i < ur_nops; i++) {
+        ur_op *op = &ur_ops[i];
+        if (op->token != token) continue;
+        if (op->state == UR_INFLIGHT) {
+            op->state = UR_ORPHAN;
+            op->token = 0;
+            ur_owned--;
+            ur_parked--;
+        } else if (op->state == UR_DONE) {
+            ur_op_free(i);
+        }
+    }
+    ur_unready(token);
+}
+
+/*
+ * sf_uring_wait — Submit everything queued and collect completions, blocking
+ * up to `timeout_ms` (0 = just check, -1 = until something completes) for at
+ * least one. `watch_fd` >= 0 also wakes the wait when that fd turns readable.
+ * Returns how many parked tasks completed; read them with sf_uring_ready().
+ */
+int64_t sf_uring_wait(int64_t timeout_ms, int64_t watch_fd) {
+    if (ur_fd < 0) return 0;
+    if (ur_ready_returned > 0) {
+        memmove(ur_ready, ur_ready + ur_ready_returned,
+                (size_t)(ur_ready_count - ur_ready_returned) * sizeof(int64_t));
+        ur_ready_count -= ur_ready_returned;
+        ur_ready_returned = 0;
+    }
+    ur_harvest();
+    int block = timeout_ms != 0 && ur_ready_count == 0 && ur_cq_empty();
+    if (block && watch_fd >= 0 && ur_watch_armed != watch_fd) {
+        struct io_uring_sqe *sqe = ur_sqe();
+        if (sqe) {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = (int)watch_fd;
+            sqe->poll_events = POLLIN;
+            sqe->user_data = UR_TAG_WATCH;
+            ur_commit();
+            ur_watch_armed = (int)watch_fd;
+        }
+    }
+    if (block && timeout_ms > 0) {
+        struct io_uring_sqe *sqe = ur_sqe();
+        if (sqe) {
+            ur_ts.tv_sec = timeout_ms / 1000;
+            ur_ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->addr = (uint64_t)(uintptr_t)&ur_ts;
+            sqe->len = 1;
+            sqe->off = 1;    /* also complete once anything else does */
+            sqe->user_data = UR_TAG_TIMEOUT;
+            ur_commit();
+        }
+    }
+    /* Nothing could ever complete: don't block forever. */
+    if (block && ur_inflight == 0 && ur_watch_armed < 0 && timeout_ms < 0) block = 0;
+    if (ur_queued > 0 || block) {
+        int rc = ur_enter(ur_queued, block ? 1 : 0, block ? IORING_ENTER_GETEVENTS : 0);
+        if (rc > 0) ur_queued -= (unsigned)rc;
+    }
+    ur_harvest();
+    ur_ready_returned = ur_ready_count;
+    return ur_ready_count;
+}
+
+/* sf_uring_ready — The i-th task handle the last sf_uring_wait() completed. */
+int64_t sf_uring_ready(int64_t i) {
+    if (i < 0 || i >= ur_ready_returned) return -1;
+    return ur_ready[i];
+}
+
+/* sf_uring_parked — Tasks currently suspended on a completion. */
+int64_t sf_uring_parked(void) {
+    return ur_parked;
+}
+
+/*
+ * sf_uring_reset — Forget every parked task (the scheduler's test reset).
+ * Their completed ops are freed; those still in flight are orphaned.
+ */
+void sf_uring_reset(void) {
+    for (int i = 0; i < ur_nops; i++) {
+        if (ur_ops[i].token == 0) continue;
+        if (ur_ops[i].state == UR_INFLIGHT) {
+            ur_ops[i].state = UR_ORPHAN;
+            ur_ops[i].token = 0;
+        } else if (ur_ops[i].state == UR_DONE) {
+            ur_op_free(i);
+        }
+    }
+    ur_owned = 0;
+    ur_parked = 0;
+    ur_ready_count = 0;
+    ur_ready_returned = 0;
+}
+
+#else /* !SF_URING — the backend is never available; callers use readiness */
+
+int64_t sf_uring_enabled(void) { return 0; }
+int64_t sf_uring_accept(int64_t fd) { (void)fd; return -1; }
+int64_t sf_uring_recv(int64_t fd, char *buf, int64_t len) { (void)fd; (void)buf; (void)len; return -1; }
+int64_t sf_uring_send(int64_t fd, const char *buf, int64_t len) { (void)fd; (void)buf; (void)len; return -1; }
+int64_t sf_uring_read(int64_t fd, char *buf, int64_t len, int64_t offset) {
+    (void)fd; (void)buf; (void)len; (void)offset;
+    return -1;
+}
+int64_t sf_uring_write(int64_t fd, const char *buf, int64_t len, int64_t offset) {
+    (void)fd; (void)buf; (void)len; (void)offset;
+    return -1;
+}
+int64_t sf_uring_result(int64_t op) { (void)op; return -2; }
+int64_t sf_uring_park(int64_t op, int64_t token) { (void)op; (void)token; return 1; }
+int64_t sf_uring_wait(int64_t timeout_ms, int64_t watch_fd) { (void)timeout_ms; (void)watch_fd; return 0; }
+int64_t sf_uring_ready(int64_t i) { (void)i; return -1; }
+int64_t sf_uring_parked(void) { return 0; }
+void sf_uring_forget(int64_t token) { (void)token; }
+void sf_uring_reset(void) {}
+
+#endif
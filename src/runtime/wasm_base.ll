@@ -145,6 +145,21 @@ entry:
   ret i64 0
 }
 
+define void @__mem_set_soft_limit(i64 %bytes) {
+entry:
+  ret void
+}
+
+define i64 @__mem_get_soft_limit() {
+entry:
+  ret i64 0
+}
+
+define i64 @__mem_pressure_collections() {
+entry:
+  ret i64 0
+}
+
 ; --- String Operations ---
 
 define i64 @strlen(i8* %s) {
@@ -1182,6 +1197,91 @@ entry:
   ret i64 0
 }
 
+; Weak references and ephemerons: no tracing collector here, so nothing is ever
+; cleared. __gc_weak_supported returns 0 and src/lib/gc.sf keeps WeakRef and
+; WeakMap contents strongly instead of calling the rest of these.
+define i64 @__gc_weak_supported() {
+entry:
+  ret i64 0
+}
+
+define i8* @__gc_weak_new(i64 %target) {
+entry:
+  ret i8* null
+}
+
+define i64 @__gc_weak_get(i64 %cell) {
+entry:
+  ret i64 0
+}
+
+define i64 @__gc_weak_alive(i64 %cell) {
+entry:
+  ret i64 0
+}
+
+define i8* @__gc_ephemeron_new() {
+entry:
+  ret i8* null
+}
+
+define i64 @__gc_ephemeron_count(i64 %table) {
+entry:
+  ret i64 0
+}
+
+define i64 @__gc_ephemeron_capacity(i64 %table) {
+entry:
+  ret i64 0
+}
+
+define i64 @__gc_ephemeron_find(i64 %table, i64 %key) {
+entry:
+  ret i64 -1
+}
+
+define i64 @__gc_ephemeron_used(i64 %table, i64 %i) {
+entry:
+  ret i64 0
+}
+
+define i64 @__gc_ephemeron_key_at(i64 %table, i64 %i) {
+entry:
+  ret i64 0
+}
+
+define i64 @__gc_ephemeron_value_at(i64 %table, i64 %i) {
+entry:
+  ret i64 0
+}
+
+define void @__gc_ephemeron_set(i64 %table, i64 %key, i64 %val) {
+entry:
+  ret void
+}
+
+define i64 @__gc_ephemeron_remove(i64 %table, i64 %key) {
+entry:
+  ret i64 0
+}
+
+; GC telemetry (src/lib/gc.sf): there are no collections to time here, so
+; GC.telemetry() reads all zeros.
+define i64 @sf_gc_telemetry_get(i64 %which) {
+entry:
+  ret i64 0
+}
+
+define double @sf_gc_telemetry_rate(i64 %which) {
+entry:
+  ret double 0.0
+}
+
+define void @sf_gc_telemetry_reset() {
+entry:
+  ret void
+}
+
 define i64 @__gc_stat_threshold() {
 entry:
   ret i64 0
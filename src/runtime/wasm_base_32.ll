@@ -199,6 +199,21 @@ entry:
   ret i64 0
 }
 
+define void @__mem_set_soft_limit(i64 %bytes) {
+entry:
+  ret void
+}
+
+define i64 @__mem_get_soft_limit() {
+entry:
+  ret i64 0
+}
+
+define i64 @__mem_pressure_collections() {
+entry:
+  ret i64 0
+}
+
 ; --- String Operations ---
 
 define i64 @strlen(i8* %s) {
@@ -380,6 +395,31 @@ entry:
   ret i64 %ne
 }
 
+; __string_hash: FNV-1a 64-bit hash of a null-terminated string, the same
+; function base.ll exports. Here the caller hands over the untagged pointer
+; (@concurrent_map declares it `i64 __string_hash(i8*)`).
+define i64 @__string_hash(i8* %s) {
+entry:
+  br label %loop
+
+loop:
+  %hash = phi i64 [ -3750763034362895579, %entry ], [ %new_hash, %next ]
+  %p = phi i8* [ %s, %entry ], [ %p_next, %next ]
+  %byte = load i8, i8* %p
+  %is_zero = icmp eq i8 %byte, 0
+  br i1 %is_zero, label %done, label %next
+
+next:
+  %byte_ext = zext i8 %byte to i64
+  %xored = xor i64 %hash, %byte_ext
+  %new_hash = mul i64 %xored, 1099511628211
+  %p_next = getelementptr i8, i8* %p, i32 1
+  br label %loop
+
+done:
+  ret i64 %hash
+}
+
 ; --- I/O Dispatch ---
 
 define void @__io_println_str(i64 %s) {
@@ -1774,6 +1814,91 @@ entry:
   ret i64 0
 }
 
+; Weak references and ephemerons: no tracing collector here, so nothing is ever
+; cleared. __gc_weak_supported returns 0 and src/lib/gc.sf keeps WeakRef and
+; WeakMap contents strongly instead of calling the rest of these.
+define i64 @__gc_weak_supported() {
+entry:
+  ret i64 0
+}
+
+define i8* @__gc_weak_new(i64 %target) {
+entry:
+  ret i8* null
+}
+
+define i64 @__gc_weak_get(i64 %cell) {
+entry:
+  ret i64 0
+}
+
+define i64 @__gc_weak_alive(i64 %cell) {
+entry:
+  ret i64 0
+}
+
+define i8* @__gc_ephemeron_new() {
+entry:
+  ret i8* null
+}
+
+define i64 @__gc_ephemeron_count(i64 %table) {
+entry:
+  ret i64 0
+}
+
+define i64 @__gc_ephemeron_capacity(i64 %table) {
+entry:
+  ret i64 0
+}
+
+define i64 @__gc_ephemeron_find(i64 %table, i64 %key) {
+entry:
+  ret i64 -1
+}
+
+define i64 @__gc_ephemeron_used(i64 %table, i64 %i) {
+entry:
+  ret i64 0
+}
+
+define i64 @__gc_ephemeron_key_at(i64 %table, i64 %i) {
+entry:
+  ret i64 0
+}
+
+define i64 @__gc_ephemeron_value_at(i64 %table, i64 %i) {
+entry:
+  ret i64 0
+}
+
+define void @__gc_ephemeron_set(i64 %table, i64 %key, i64 %val) {
+entry:
+  ret void
+}
+
+define i64 @__gc_ephemeron_remove(i64 %table, i64 %key) {
+entry:
+  ret i64 0
+}
+
+; GC telemetry (src/lib/gc.sf): there are no collections to time here, so
+; GC.telemetry() reads all zeros.
+define i64 @sf_gc_telemetry_get(i64 %which) {
+entry:
+  ret i64 0
+}
+
+define double @sf_gc_telemetry_rate(i64 %which) {
+entry:
+  ret double 0.0
+}
+
+define void @sf_gc_telemetry_reset() {
+entry:
+  ret void
+}
+
 define i64 @__gc_stat_threshold() {
 entry:
   ret i64 0
@@ -2116,76 +2241,181 @@ entry:
 }
 
 ; --- Per-task result storage ---
-; Fixed 256-entry (handle, value) table, matching async_native.c. Linear scan
-; from the newest entry backwards so a re-used handle resolves to its latest
-; result.
-@__task_res_handles = global [256 x i64] zeroinitializer
-@__task_res_values = global [256 x i64] zeroinitializer
-@__task_res_count = global i32 0
+; The same control blocks as async_native.c — value, done flag and pins per
+; task, read any number of times — but found by a linear scan over the slots in
+; use instead of a hash table. There is no collector here (see the GC stubs
+; above), so nothing ever finds a block unreachable and blocks are never
+; released, like the rest of a page's heap.
+; A block is 4 x i64: handle, value, pins, done.
+@__task_res_blocks = global i64* null
+@__task_res_cap = global i32 0
+@__task_res_used = global i32 0
+
+define private i64* @__task_res_field(i32 %slot, i32 %field) {
+entry:
+  %base = load i64*, i64** @__task_res_blocks
+  %i4 = shl i32 %slot, 2
+  %idx = add i32 %i4, %field
+  %p = getelementptr i64, i64* %base, i32 %idx
+  ret i64* %p
+}
+
+define private i32 @__task_res_find(i64 %handle) {
+entry:
+  %used = load i32, i32* @__task_res_used
+  %is_zero = icmp eq i64 %handle, 0
+  br i1 %is_zero, label %not_found, label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inext, %next ]
+  %in_range = icmp slt i32 %i, %used
+  br i1 %in_range, label %check, label %not_found
+check:
+  %hp = call i64* @__task_res_field(i32 %i, i32 0)
+  %h = load i64, i64* %hp
+  %match = icmp eq i64 %h, %handle
+  br i1 %match, label %found, label %next
+found:
+  ret i32 %i
+next:
+  %inext = add i32 %i, 1
+  br label %loop
+not_found:
+  ret i32 -1
+}
+
+; The block for %handle, created (not done, not pinned) if it has none.
+define private i32 @__task_res_block(i64 %handle) {
+entry:
+  %found = call i32 @__task_res_find(i64 %handle)
+  %have = icmp sge i32 %found, 0
+  %is_zero = icmp eq i64 %handle, 0
+  %early = or i1 %have, %is_zero
+  br i1 %early, label %ret_found, label %alloc
+ret_found:
+  ret i32 %found
+alloc:
+  %used = load i32, i32* @__task_res_used
+  %cap = load i32, i32* @__task_res_cap
+  %full = icmp eq i32 %used, %cap
+  br i1 %full, label %grow, label %take
+grow:
+  %doubled = shl i32 %cap, 1
+  %empty = icmp eq i32 %cap, 0
+  %new_cap = select i1 %empty, i32 64, i32 %doubled
+  %old = load i64*, i64** @__task_res_blocks
+  %old8 = bitcast i64* %old to i8*
+  %bytes32 = shl i32 %new_cap, 5
+  %bytes = zext i32 %bytes32 to i64
+  %grown8 = call i8* @realloc(i8* %old8, i64 %bytes)
+  %grown = bitcast i8* %grown8 to i64*
+  store i64* %grown, i64** @__task_res_blocks
+  store i32 %new_cap, i32* @__task_res_cap
+  br label %take
+take:
+  %used1 = add i32 %used, 1
+  store i32 %used1, i32* @__task_res_used
+  %hp = call i64* @__task_res_field(i32 %used, i32 0)
+  store i64 %handle, i64* %hp
+  %vp = call i64* @__task_res_field(i32 %used, i32 1)
+  store i64 0, i64* %vp
+  %cp = call i64* @__task_res_field(i32 %used, i32 2)
+  store i64 0, i64* %cp
+  %dp = call i64* @__task_res_field(i32 %used, i32 3)
+  store i64 0, i64* %dp
+  ret i32 %used
+}
 
 define void @__sched_store_result(i64 %handle, i64 %value) {
 entry:
-  %n = load i32, i32* @__task_res_count
-  %full = icmp sge i32 %n, 256
-  br i1 %full, label %done, label %store
+  %slot = call i32 @__task_res_block(i64 %handle)
+  %ok = icmp sge i32 %slot, 0
+  br i1 %ok, label %store, label %done
 store:
-  %hp = getelementptr [256 x i64], [256 x i64]* @__task_res_handles, i32 0, i32 %n
-  store i64 %handle, i64* %hp
-  %vp = getelementptr [256 x i64], [256 x i64]* @__task_res_values, i32 0, i32 %n
+  %vp = call i64* @__task_res_field(i32 %slot, i32 1)
   store i64 %value, i64* %vp
-  %n1 = add i32 %n, 1
-  store i32 %n1, i32* @__task_res_count
+  %dp = call i64* @__task_res_field(i32 %slot, i32 3)
+  store i64 1, i64* %dp
   br label %done
 done:
   ret void
 }
 
-define i64 @__sched_get_stored_result(i64 %handle) {
+define void @__sched_result_pin(i64 %handle) {
 entry:
-  %n = load i32, i32* @__task_res_count
-  %i0 = sub i32 %n, 1
-  br label %loop
-loop:
-  %i = phi i32 [ %i0, %entry ], [ %inext, %next ]
-  %in_range = icmp sge i32 %i, 0
-  br i1 %in_range, label %check, label %not_found
+  %slot = call i32 @__task_res_block(i64 %handle)
+  %ok = icmp sge i32 %slot, 0
+  br i1 %ok, label %pin, label %done
+pin:
+  %pp = call i64* @__task_res_field(i32 %slot, i32 2)
+  %pins = load i64, i64* %pp
+  %p = add i64 %pins, 1
+  store i64 %p, i64* %pp
+  br label %done
+done:
+  ret void
+}
+
+define void @__sched_result_unpin(i64 %handle) {
+entry:
+  %slot = call i32 @__task_res_find(i64 %handle)
+  %ok = icmp sge i32 %slot, 0
+  br i1 %ok, label %check, label %done
 check:
-  %hp = getelementptr [256 x i64], [256 x i64]* @__task_res_handles, i32 0, i32 %i
-  %h = load i64, i64* %hp
-  %match = icmp eq i64 %h, %handle
-  br i1 %match, label %found, label %next
-found:
-  %vp = getelementptr [256 x i64], [256 x i64]* @__task_res_values, i32 0, i32 %i
+  %pp = call i64* @__task_res_field(i32 %slot, i32 2)
+  %pins = load i64, i64* %pp
+  %held = icmp sgt i64 %pins, 0
+  br i1 %held, label %unpin, label %done
+unpin:
+  %p = sub i64 %pins, 1
+  store i64 %p, i64* %pp
+  br label %done
+done:
+  ret void
+}
+
+define i64 @__sched_result_blocks() {
+entry:
+  %used = load i32, i32* @__task_res_used
+  %n = sext i32 %used to i64
+  ret i64 %n
+}
+
+; The done block for %handle, or -1.
+define private i32 @__task_res_done(i64 %handle) {
+entry:
+  %slot = call i32 @__task_res_find(i64 %handle)
+  %ok = icmp sge i32 %slot, 0
+  br i1 %ok, label %check, label %none
+check:
+  %dp = call i64* @__task_res_field(i32 %slot, i32 3)
+  %d = load i64, i64* %dp
+  %is_done = icmp ne i64 %d, 0
+  br i1 %is_done, label %yes, label %none
+yes:
+  ret i32 %slot
+none:
+  ret i32 -1
+}
+
+define i64 @__sched_get_stored_result(i64 %handle) {
+entry:
+  %slot = call i32 @__task_res_done(i64 %handle)
+  %ok = icmp sge i32 %slot, 0
+  br i1 %ok, label %read, label %none
+read:
+  %vp = call i64* @__task_res_field(i32 %slot, i32 1)
   %v = load i64, i64* %vp
   ret i64 %v
-next:
-  %inext = sub i32 %i, 1
-  br label %loop
-not_found:
+none:
   ret i64 0
 }
 
 define i64 @__sched_has_stored_result(i64 %handle) {
 entry:
-  %n = load i32, i32* @__task_res_count
-  %i0 = sub i32 %n, 1
-  br label %loop
-loop:
-  %i = phi i32 [ %i0, %entry ], [ %inext, %next ]
-  %in_range = icmp sge i32 %i, 0
-  br i1 %in_range, label %check, label %not_found
-check:
-  %hp = getelementptr [256 x i64], [256 x i64]* @__task_res_handles, i32 0, i32 %i
-  %h = load i64, i64* %hp
-  %match = icmp eq i64 %h, %handle
-  br i1 %match, label %found, label %next
-found:
-  ret i64 1
-next:
-  %inext = sub i32 %i, 1
-  br label %loop
-not_found:
-  ret i64 0
+  %slot = call i32 @__task_res_done(i64 %handle)
+  %ok = icmp sge i32 %slot, 0
+  %r = zext i1 %ok to i64
+  ret i64 %r
 }
 
 ; --- Coroutine frame access ---
@@ -2231,6 +2461,33 @@ not_done:
   ret i64 0
 }
 
+; Actor busy word: the first i64 of an actor object (see async_native.c).
+define i64 @__sched_actor_busy(i64 %actor) {
+entry:
+  %a32 = trunc i64 %actor to i32
+  %null = icmp eq i32 %a32, 0
+  br i1 %null, label %idle, label %load
+load:
+  %p = inttoptr i32 %a32 to i64*
+  %v = load i64, i64* %p
+  ret i64 %v
+idle:
+  ret i64 0
+}
+
+define void @__sched_actor_set_busy(i64 %actor, i64 %busy) {
+entry:
+  %a32 = trunc i64 %actor to i32
+  %null = icmp eq i32 %a32, 0
+  br i1 %null, label %done, label %store
+store:
+  %p = inttoptr i32 %a32 to i64*
+  store i64 %busy, i64* %p
+  br label %done
+done:
+  ret void
+}
+
 define void @__sched_coro_destroy(i64 %hdl) {
 entry:
   %h32 = trunc i64 %hdl to i32
@@ -2250,6 +2507,85 @@ done:
   ret void
 }
 
+; --- Coroutine frame pool ---
+; As in async_native.c: freed frames go on a free list per 64-byte size class
+; and are handed straight back out. Here that is the only reuse there is, since
+; the bump allocator never frees. An 8-byte header {i32 class, i32 next} sits in
+; front of each frame; class 0 marks a frame over 4 KB, which is not pooled. A
+; pooled frame reads as finished and has nothing to destroy until it is reused.
+@__coro_pool = global [65 x i32] zeroinitializer
+
+define ptr @__sf_coro_alloc(i64 %size) {
+entry:
+  %none = icmp sle i64 %size, 0
+  br i1 %none, label %elided, label %sized
+elided:
+  ret ptr null
+sized:
+  %size32 = trunc i64 %size to i32
+  %round = add i32 %size32, 63
+  %cls = lshr i32 %round, 6
+  %big = icmp ugt i32 %cls, 64
+  br i1 %big, label %unpooled, label %pooled
+unpooled:
+  %ubytes = add i32 %size32, 8
+  %ubytes64 = zext i32 %ubytes to i64
+  %uh = call i8* @malloc(i64 %ubytes64)
+  %uclsp = bitcast i8* %uh to i32*
+  store i32 0, i32* %uclsp
+  %uframe = getelementptr i8, i8* %uh, i32 8
+  ret ptr %uframe
+pooled:
+  %headp = getelementptr [65 x i32], [65 x i32]* @__coro_pool, i32 0, i32 %cls
+  %head = load i32, i32* %headp
+  %empty = icmp eq i32 %head, 0
+  br i1 %empty, label %fresh, label %reuse
+reuse:
+  %rh = inttoptr i32 %head to i8*
+  %rnextp8 = getelementptr i8, i8* %rh, i32 4
+  %rnextp = bitcast i8* %rnextp8 to i32*
+  %rnext = load i32, i32* %rnextp
+  store i32 %rnext, i32* %headp
+  br label %out
+fresh:
+  %class_bytes = shl i32 %cls, 6
+  %fbytes = add i32 %class_bytes, 8
+  %fbytes64 = zext i32 %fbytes to i64
+  %fh = call i8* @malloc(i64 %fbytes64)
+  %fclsp = bitcast i8* %fh to i32*
+  store i32 %cls, i32* %fclsp
+  br label %out
+out:
+  %h = phi i8* [ %rh, %reuse ], [ %fh, %fresh ]
+  %frame = getelementptr i8, i8* %h, i32 8
+  ret ptr %frame
+}
+
+define void @__sf_coro_free(ptr %frame) {
+entry:
+  %null = icmp eq ptr %frame, null
+  br i1 %null, label %done, label %check
+check:
+  %h = getelementptr i8, ptr %frame, i32 -8
+  %cls = load i32, ptr %h
+  %unpooled = icmp eq i32 %cls, 0
+  br i1 %unpooled, label %done, label %pool
+pool:
+  ; Finished and not destroyable: clear the resume and destroy pointers.
+  store ptr null, ptr %frame
+  %dp = getelementptr i8, ptr %frame, i32 4
+  store ptr null, ptr %dp
+  %headp = getelementptr [65 x i32], [65 x i32]* @__coro_pool, i32 0, i32 %cls
+  %head = load i32, i32* %headp
+  %nextp = getelementptr i8, ptr %h, i32 4
+  store i32 %head, ptr %nextp
+  %h32 = ptrtoint ptr %h to i32
+  store i32 %h32, i32* %headp
+  br label %done
+done:
+  ret void
+}
+
 ; --- Host-only helpers that the wasm build still references ---
 
 ; The native runtime interns strings so identical literals share one allocation.
@@ -2309,6 +2645,210 @@ entry:
   ret i64 0
 }
 
+; The readiness reactor (reactor_native.c on native) for the same reason: arming
+; succeeds and nothing ever becomes ready, so an fd-parked task stays parked
+; until its deadline. The wait returns at once instead of sleeping — the JS pump
+; calls scheduler_tick() again on the next microtask, and blocking would freeze
+; the tab.
+define i64 @sf_reactor_arm(i64 %fd, i64 %mode, i64 %token) {
+entry:
+  ret i64 0
+}
+
+define void @sf_reactor_cancel(i64 %fd, i64 %mode, i64 %token) {
+entry:
+  ret void
+}
+
+define i64 @sf_reactor_wait(i64 %timeout_ms) {
+entry:
+  ret i64 0
+}
+
+define i64 @sf_reactor_ready(i64 %i) {
+entry:
+  ret i64 -1
+}
+
+define void @sf_reactor_reset() {
+entry:
+  ret void
+}
+
+define i64 @sf_reactor_fd() {
+entry:
+  ret i64 -1
+}
+
+; The io_uring backend (uring_native.c) is never enabled in a browser, so no
+; task ever suspends on a completion and these are never reached with work.
+define i64 @sf_uring_enabled() {
+entry:
+  ret i64 0
+}
+
+define i64 @sf_uring_park(i64 %op, i64 %token) {
+entry:
+  ret i64 1
+}
+
+define i64 @sf_uring_wait(i64 %timeout_ms, i64 %watch_fd) {
+entry:
+  ret i64 0
+}
+
+define i64 @sf_uring_ready(i64 %i) {
+entry:
+  ret i64 -1
+}
+
+define void @sf_uring_reset() {
+entry:
+  ret void
+}
+
+; There are no helper threads in a browser: the offload pool never hands out an
+; op, so nothing suspends with reason 8 and the pipe is never armed.
+define void @sf_offload_in_task(i64 %on) {
+entry:
+  ret void
+}
+
+define i64 @sf_offload_park(i64 %op, i64 %token) {
+entry:
+  ret i64 1
+}
+
+define i64 @sf_offload_fd() {
+entry:
+  ret i64 -1
+}
+
+define i64 @sf_offload_drain() {
+entry:
+  ret i64 0
+}
+
+define i64 @sf_offload_ready(i64 %i) {
+entry:
+  ret i64 -1
+}
+
+; Scheduler instrumentation (schedstats_native.c) reads a monotonic clock per
+; resume and has no stderr to trace to; in a browser it is never on, so the
+; scheduler never calls the hooks and stats() reads all zeros.
+define i64 @sf_sched_stats_on() {
+entry:
+  ret i64 0
+}
+
+define void @sf_sched_stats_enable(i64 %on) {
+entry:
+  ret void
+}
+
+define void @sf_sched_stat_tick_begin() {
+entry:
+  ret void
+}
+
+define void @sf_sched_stat_woke() {
+entry:
+  ret void
+}
+
+define void @sf_sched_stat_ready(i64 %handle) {
+entry:
+  ret void
+}
+
+define void @sf_sched_stat_run(i64 %handle, i64 %depth) {
+entry:
+  ret void
+}
+
+define void @sf_sched_stat_ran(i64 %handle, i64 %reason) {
+entry:
+  ret void
+}
+
+define void @sf_sched_stat_lag(double %late) {
+entry:
+  ret void
+}
+
+define void @sf_sched_stat_tick_end() {
+entry:
+  ret void
+}
+
+define i64 @sf_sched_stats_get(i64 %which) {
+entry:
+  ret i64 0
+}
+
+define i64 @sf_sched_stats_counter(i64 %id) {
+entry:
+  ret i64 0
+}
+
+define double @sf_sched_stats_rq_avg() {
+entry:
+  ret double 0.0
+}
+
+define i64 @sf_sched_stats_longest_entry() {
+entry:
+  ret i64 0
+}
+
+define void @sf_sched_stats_reset() {
+entry:
+  ret void
+}
+
+; Timeline tracing (trace_native.c) writes its trace to a file, which a browser
+; does not have: recording never starts, so nothing is ever traced.
+define i64 @sf_trace_on() {
+entry:
+  ret i64 0
+}
+
+define i64 @sf_trace_start(i8* %path) {
+entry:
+  ret i64 0
+}
+
+define void @sf_trace_stop() {
+entry:
+  ret void
+}
+
+define i64 @sf_trace_flush() {
+entry:
+  ret i64 -1
+}
+
+define void @sf_trace_begin(i8* %name, i8* %detail) {
+entry:
+  ret void
+}
+
+define void @sf_trace_end(i8* %detail) {
+entry:
+  ret void
+}
+
+define void @sf_trace_task_resume(i64 %handle) {
+entry:
+  ret void
+}
+
+define void @sf_trace_task_suspend(i64 %handle, i64 %reason) {
+entry:
+  ret void
+}
+
 ; =============================================================================
 ; Scheduler pump — the JS interop entry point
 ;
@@ -159,6 +159,8 @@ declare void @__sched_reset_yield()
 declare void @__sched_store_result(i64, i64)
 declare i64 @__sched_get_stored_result(i64)
 declare i64 @__sched_has_stored_result(i64)
+declare void @__sched_result_pin(i64)
+declare void @__sched_result_unpin(i64)
 
 define i64 @max(i64 %a.arg, i64 %b.arg) {
 entry:
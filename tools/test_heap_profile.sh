@@ -0,0 +1,144 @@
+#!/usr/bin/env bash
+# test_heap_profile.sh — verify the SAFFRON_HEAP_PROFILE sampling profiler.
+#
+# The profiler (src/runtime/heapprof_native.c, with the allocation countdown
+# in gc.ll) is switched on by environment variables read at startup and its
+# output is files next to a prefix, neither of which tools/run_tests.sh can
+# see. Programs are built once and the binaries run directly: under
+# `saffron run` the variables would also profile the compiler, which writes
+# its own profile to the same prefix when it exits.
+#
+# Usage: tools/test_heap_profile.sh
+# Exits 0 if every case matches, 1 otherwise.
+
+set -uo pipefail
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+SAFFRON="$ROOT/tools/saffron"
+TMPDIR="$(mktemp -d)"
+trap 'rm -rf "$TMPDIR"' EXIT
+
+PASS=0
+FAIL=0
+
+# Steady allocation from one function, keeping every hundredth list alive so
+# the in-use profile has something left in it at exit.
+cat >"$TMPDIR/alloc.sf" <<'EOF'
+var keep: List<List<Int>> = []
+
+fun fill(n: Int): List<Int> {
+    var xs: List<Int> = []
+    for (j = 0; j < n; j = j + 1) { xs.push(j) }
+    return xs
+}
+
+for (i = 0; i < 20000; i = i + 1) {
+    var xs = fill(100)
+    if (i % 100 == 0) { keep.push(xs) }
+}
+IO.println("kept=${keep.length()}")
+EOF
+
+# SIGUSR2 asks for a dump without exiting. The handler only flags it; the
+# profile is written by the next allocation, so churn a little before looking.
+cat >"$TMPDIR/signal.sf" <<'EOF'
+import "@signal" as Signal
+
+fun churn(rounds: Int): Int {
+    var total = 0
+    for (i = 0; i < rounds; i = i + 1) {
+        var chunk: List<Int> = []
+        for (j = 0; j < 100; j = j + 1) { chunk.push(j) }
+        total = total + chunk.length()
+    }
+    return total
+}
+
+churn(2000)
+Signal.raise(Signal.SIGUSR2)
+churn(2000)
+IO.println("dumped=${IO.file_exists("sig.alloc.folded")}")
+EOF
+
+# expect <label> <expected-rc> <expected-substring-or-empty> -- <cmd...>
+expect() {
+    local label="$1" want_rc="$2" want_out="$3"; shift 3
+    [[ "$1" == "--" ]] && shift
+    local out rc
+    out="$("$@" 2>&1)"; rc=$?
+    if [[ "$rc" != "$want_rc" ]]; then
+        printf 'FAIL  %-44s expected exit %s, got %s\n' "$label" "$want_rc" "$rc"
+        printf '      output: %s\n' "$(tail -1 <<<"$out")"
+        FAIL=$((FAIL + 1)); return
+    fi
+    if [[ -n "$want_out" && "$out" != *"$want_out"* ]]; then
+        printf 'FAIL  %-44s exit %s ok, but output lacked %q\n' "$label" "$rc" "$want_out"
+        printf '      output: %s\n' "$(tail -1 <<<"$out")"
+        FAIL=$((FAIL + 1)); return
+    fi
+    printf 'PASS  %-44s exit %s\n' "$label" "$rc"
+    PASS=$((PASS + 1))
+}
+
+# expect_stacks <label> <file>: the file exists and holds at least one sampled
+# stack in folded form — frames joined by ';', a space, a positive byte count.
+expect_stacks() {
+    local label="$1" file="$2"
+    if [[ ! -f "$file" ]]; then
+        printf 'FAIL  %-44s %s was not written\n' "$label" "${file#$TMPDIR/}"
+        FAIL=$((FAIL + 1)); return
+    fi
+    if ! grep -Eq '^[^ ]+;[^ ]+ [1-9][0-9]*$' "$file"; then
+        printf 'FAIL  %-44s no sampled stack in %s\n' "$label" "${file#$TMPDIR/}"
+        printf '      first line: %s\n' "$(head -1 "$file")"
+        FAIL=$((FAIL + 1)); return
+    fi
+    printf 'PASS  %-44s %s lines\n' "$label" "$(wc -l <"$file" | tr -d ' ')"
+    PASS=$((PASS + 1))
+}
+
+echo "--- build ---"
+expect "build alloc.sf" 0 "" -- \
+    "$SAFFRON" build "$TMPDIR/alloc.sf" -o "$TMPDIR/alloc"
+expect "build signal.sf" 0 "" -- \
+    "$SAFFRON" build "$TMPDIR/signal.sf" -o "$TMPDIR/signal"
+
+echo "--- off by default: no profile without SAFFRON_HEAP_PROFILE ---"
+mkdir -p "$TMPDIR/off"
+expect "unprofiled run" 0 "kept=200" -- \
+    bash -c 'cd "$1" && "$2"' _ "$TMPDIR/off" "$TMPDIR/alloc"
+if compgen -G "$TMPDIR/off/*.folded" >/dev/null; then
+    printf 'FAIL  %-44s found %s\n' "no .folded files written" "$(ls "$TMPDIR/off")"
+    FAIL=$((FAIL + 1))
+else
+    printf 'PASS  %-44s\n' "no .folded files written"
+    PASS=$((PASS + 1))
+fi
+
+echo "--- dump at exit, sampling every 4k ---"
+expect "SAFFRON_HEAP_PROFILE_RATE=4k" 0 "kept=200" -- \
+    env SAFFRON_HEAP_PROFILE="$TMPDIR/exit" SAFFRON_HEAP_PROFILE_RATE=4k "$TMPDIR/alloc"
+expect_stacks "alloc profile has sampled stacks" "$TMPDIR/exit.alloc.folded"
+expect_stacks "inuse profile has the kept lists" "$TMPDIR/exit.inuse.folded"
+if [[ -f "$TMPDIR/exit.survived.folded" ]]; then
+    printf 'PASS  %-44s\n' "survived profile written"
+    PASS=$((PASS + 1))
+else
+    printf 'FAIL  %-44s\n' "survived profile written"
+    FAIL=$((FAIL + 1))
+fi
+
+echo "--- dump on SIGUSR2, before exit ---"
+mkdir -p "$TMPDIR/sig"
+expect "SIGUSR2 writes the profile mid-run" 0 "dumped=true" -- \
+    bash -c 'cd "$1" && SAFFRON_HEAP_PROFILE=sig SAFFRON_HEAP_PROFILE_RATE=4k "$2"' \
+    _ "$TMPDIR/sig" "$TMPDIR/signal"
+expect_stacks "signal dump has sampled stacks" "$TMPDIR/sig/sig.alloc.folded"
+
+echo "--- a malformed rate is a usage error, not a silent default ---"
+expect "SAFFRON_HEAP_PROFILE_RATE=bogus" 1 "invalid SAFFRON_HEAP_PROFILE_RATE" -- \
+    env SAFFRON_HEAP_PROFILE="$TMPDIR/bad" SAFFRON_HEAP_PROFILE_RATE=bogus "$TMPDIR/alloc"
+
+echo
+echo "TOTAL: $PASS passed, $FAIL failed"
+[[ $FAIL -eq 0 ]]
@@ -38,6 +38,21 @@ for (i = 0; i < 12; i = i + 1) { s = s + s }
 IO.println("len=${s.length()}")
 EOF
 
+# Churn: far more total allocation than a 16m cap, but almost none of it live.
+# The auto-collect threshold is pushed out of reach so that only the soft-limit
+# pressure collections can keep it under the cap.
+cat >"$TMPDIR/churn.sf" <<'EOF'
+import "@gc" as Memory
+Memory.set_threshold(1099511627776)
+var total = 0
+for (i = 0; i < 50000; i = i + 1) {
+    var chunk: List<Int> = []
+    for (j = 0; j < 100; j = j + 1) { chunk.push(j) }
+    total = total + chunk.length()
+}
+IO.println("total=${total} pressure=${Memory.pressure_collections() > 0}")
+EOF
+
 # expect <label> <expected-rc> <expected-substring-or-empty> -- <cmd...>
 expect() {
     local label="$1" want_rc="$2" want_out="$3"; shift 3
@@ -77,6 +92,16 @@ echo "--- env var is equivalent to the flag ---"
 expect "SAFFRON_MAX_MEMORY=16m" 3 "out of memory" -- \
     env SAFFRON_MAX_MEMORY=16m "$SAFFRON" run "$TMPDIR/overflow.sf"
 
+echo "--- soft limit: transient garbage is collected before it breaches ---"
+expect "--max-memory 16m, churning program" 0 "pressure=true" -- \
+    "$SAFFRON" run --max-memory 16m "$TMPDIR/churn.sf"
+
+expect "SAFFRON_SOFT_MEMORY=4m under a 16m cap" 0 "pressure=true" -- \
+    env SAFFRON_SOFT_MEMORY=4m "$SAFFRON" run --max-memory 16m "$TMPDIR/churn.sf"
+
+expect "SAFFRON_SOFT_MEMORY=bogus" 1 "invalid SAFFRON_SOFT_MEMORY" -- \
+    env SAFFRON_SOFT_MEMORY=bogus "$SAFFRON" run "$TMPDIR/modest.sf"
+
 echo "--- suffixes accepted (k/m/g, case-insensitive) ---"
 for sz in 512k 512K 64m 64M 1g 1G 67108864; do
     expect "suffix '$sz' accepted" 0 "len=4096" -- \